@@ -22,6 +22,14 @@ int main()
     int32_t box_body = world.createBody(PhysicsShape::MakeOBB(Vector3(0.125, 2.0, 0.125)), 10.0, PhysicsLayer::DYNAMIC);
     int32_t weight_body = world.createBody(PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), Vector3(0.0, -2.5, 0.0), Quaternion(Eigen::AngleAxis(0.0, Vector3(1.0, 0.0, 0.0))), 100.0, PhysicsLayer::DYNAMIC);
 
+    // The rod swings about z from a static pivot at its top end, the weight hangs off the bottom end on a ball joint
+    int32_t pivot_body = world.createBody(PhysicsShape::MakeSphere(0.1), Vector3(0.0, 2.0, 0.0), 1.0, PhysicsLayer::STATIC);
+    world.createHingeJoint(pivot_body, box_body, Vector3(0.0, 2.0, 0.0), Vector3(0.0, 0.0, 1.0));
+    world.createBallJoint(box_body, weight_body, Vector3(0.0, -2.0, 0.0));
+
+    world.setGravity({ 0.0, 0.0, 0.0, 0.0, -9.8, 0.0 });
+    world.setLinearVelocity(weight_body, Vector3(4.0, 0.0, 1.0));
+
     std::shared_ptr<Geometry> box_mesh = GeometryFactory::load_rect(0.25f, 4.0f, 0.25f);
     std::shared_ptr<Geometry> weight_mesh = GeometryFactory::load_rect(1.0f, 1.0f, 1.0f);
     
@@ -74,7 +82,7 @@ int main()
         glm::mat4 view = glm::lookAt(glm::vec3(cam_radius * sin(-theta_radian) * cos(phi_radian), cam_radius * sin(phi_radian), cam_radius * cos(-theta_radian) * cos(phi_radian)), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
 
 
-        //world.update(delta);
+        world.update(time.delta());
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -23,7 +23,7 @@ int main()
 
     RigidBodyState state = {
         .velocity = velocity,
-        .spatial_inertia = spatial_inertia
+        .spatial_inertia = SpatialInertia::FromMatrix(spatial_inertia)
     };
 
     // In the simulation would multiply this by the delta time of the frame or the integration step
@@ -40,7 +40,7 @@ int main()
 
     RigidBodyState state = {
         .velocity = velocity,
-        .spatial_inertia = spatial_inertia
+        .spatial_inertia = SpatialInertia::FromMatrix(spatial_inertia)
     };
 
     Vector6 forces = calculateInverseDynamics(state, desired_acceleration, gravity);
@@ -2,6 +2,7 @@
 #include <render/render.h>
 #include <render/engine.h>
 #include <physics/physics.h>
+#include <physics/spline_path.h>
 #include <memory>
 
 double cam_radius = 5.0;
@@ -13,8 +14,6 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     cam_radius -= 0.2 * yoffset;
 }
 
-std::vector<glm::vec3> generate_spline(const std::vector<glm::vec3>& points, uint32_t subdivisions);
-
 int main()
 {
     GLFWwindow* window = init_window(WIN_WIDTH, WIN_HEIGHT, "Splines");
@@ -30,22 +29,49 @@ int main()
         exit(EXIT_FAILURE);
     }
 
+    unsigned int body_shader;
+    if (!load_shader("../shader/default.vert", "../shader/default.frag", &body_shader))
+    {
+        std::cerr << "Failed to load shader" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
     glm::mat4 projection = glm::perspective(glm::radians(90.0f), (float)WIN_WIDTH / (float)WIN_HEIGHT, 0.1f, 50.0f);
     glUseProgram(shader);
     glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUseProgram(body_shader);
+    glUniformMatrix4fv(glGetUniformLocation(body_shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
     glLineWidth(20.0);
-    std::vector<glm::vec3> points = 
+    std::vector<Vector3> points = 
     {
-        {-3.0f, 0.0f, 0.0f},
-        {0.0f, 3.0f, 0.0f},
-        {3.0f, 0.0f, 0.0f},
-        {0.0f, -7.0f, 1.0f},
-        {0.0f, 0.0f, -3.0f}
+        {-3.0, 0.0, 0.0},
+        {0.0, 3.0, 0.0},
+        {3.0, 0.0, 0.0},
+        {0.0, -7.0, 1.0},
+        {0.0, 0.0, -3.0}
     };
 
-    std::vector<glm::vec3> interpolated_points = generate_spline(points, 20);
+    // A platform carrying a ball goes round the path every 8 seconds
+    SplinePath path(points, 8.0, true);
+
+    const uint32_t subdivisions = 20;
+    std::vector<glm::vec3> interpolated_points;
+    for (uint32_t i = 0; i <= points.size() * subdivisions; i++)
+    {
+        Vector3 point = path.getPosition(path.getDuration() * i / (points.size() * subdivisions));
+        interpolated_points.push_back(glm::vec3(point.x(), point.y(), point.z()));
+    }
     std::shared_ptr<Geometry> curve = GeometryFactory::load_curve(interpolated_points);
+
+    PhysicsWorld world;
+    world.setGravity({ 0.0, 0.0, 0.0, 0.0, -9.8, 0.0 });
+    int32_t platform_body = world.createBody(PhysicsShape::MakeOBB(Vector3(0.75, 0.1, 0.75)), 1.0, PhysicsLayer::KINEMATIC);
+    world.setKinematicPath(platform_body, &path);
+    int32_t ball_body = world.createBody(PhysicsShape::MakeSphere(0.25), PhysicsMaterial{ .restitution = 0.0 }, points[0] + Vector3(0.0, 0.36, 0.0), 1.0, PhysicsLayer::DYNAMIC);
+
+    std::shared_ptr<Geometry> platform_mesh = GeometryFactory::load_rect(1.5f, 0.2f, 1.5f);
+    std::shared_ptr<Geometry> ball_mesh = GeometryFactory::load_sphere(0.25f, 3);
     
     // Delta time stuff
     EngineTime time;
@@ -60,6 +86,8 @@ int main()
         glfwPollEvents();
         time.update();
 
+        world.update(time.delta());
+
         // Camera
         double current_xpos, current_ypos;
         glfwGetCursorPos(window, &current_xpos, &current_ypos);
@@ -88,6 +116,11 @@ int main()
         glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
 
         curve->draw(shader, EigenMatrixToFloatArray(Eigen::Matrix4d::Identity()));
+
+        glUseProgram(body_shader);
+        glUniformMatrix4fv(glGetUniformLocation(body_shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        platform_mesh->draw(body_shader, EigenMatrixToFloatArray(world.getWorldMatrix(platform_body)));
+        ball_mesh->draw(body_shader, EigenMatrixToFloatArray(world.getWorldMatrix(ball_body)));
         
         glfwSwapBuffers(window);
     }
@@ -96,57 +129,3 @@ int main()
 
     return 0;
 }
-
-std::vector<glm::vec3> generate_spline(const std::vector<glm::vec3>& points, uint32_t subdivisions)
-{
-    std::vector<glm::vec3> spline_points;
-
-    // Can't have 0 subdivisions
-    if (subdivisions == 0) subdivisions = 1;
-
-
-    float tension = 1.0f;
-
-    // TODO: Fix this...
-    glm::mat4 spline_mat = 
-    {
-        0.0f, 1.0f, 0.0f, 0.0f,
-        -tension, 0.0f, tension, 0.0f,
-        2.0f * tension, tension - 3.0f, 3.0f - (2.0f * tension), -tension,
-        -tension, 2.0f - tension, tension - 2.0f, tension
-    };
-    
-    spline_mat = glm::transpose(spline_mat);
-
-    for (int i = 0; i < points.size() - 1; i++)
-    {   
-        glm::vec3 prev = i == 0 ? points[i] : points[i - 1];
-        glm::vec3 start = points[i];
-        glm::vec3 end = points[i + 1];
-        glm::vec3 next = i == points.size() - 2 ? points[i + 1] : points[i + 2];
-
-        // TODO: Fix this...
-        glm::mat4x3 point_mat = 
-        {
-            prev,
-            start,
-            end,
-            next
-        };
-
-        for (int sub = 0; sub <= subdivisions; sub++)
-        {
-            float t = (float)sub / (float)subdivisions;
-            float t_sqr = t * t;
-            float t_cube = t * t * t;
-            
-            glm::vec3 point = (-0.5f * tension * t_cube + tension * t_sqr - 0.5f * tension * t) * prev +
-                            (1.0f + 0.5f * t_sqr * (tension - 6.0f) + 0.5f * t_cube * (4.0f - tension)) * start +
-                            (0.5f * t_cube * (tension - 4.0f) + 0.5f * tension * t - (tension - 3.0f) * t_sqr) * end +
-                            (-0.5f * tension * t_sqr + 0.5f * tension * t_cube) * next;
-            spline_points.push_back(point);
-        }   
-    }
-
-    return spline_points;
-}
\ No newline at end of file
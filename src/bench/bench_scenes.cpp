@@ -0,0 +1,364 @@
+#include "bench_scenes.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <cctype>
+#include <cmath>
+#include <random>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+#endif
+
+static std::atomic<uint64_t> allocation_count = 0;
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+uint64_t GetAllocationCount()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+// std::uniform_real_distribution differs between standard libraries, this doesn't
+static Real RandomRange(std::mt19937& rng, Real min, Real max)
+{
+    return min + (max - min) * (static_cast<Real>(rng()) / static_cast<Real>(std::mt19937::max()));
+}
+
+static Quaternion RandomOrientation(std::mt19937& rng)
+{
+    Quaternion q(RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0));
+    if (q.squaredNorm() < 1e-6) return Quaternion::Identity();
+    return q.normalized();
+}
+
+// Same floor and walls as the bouncing_sphere demo
+static void BuildBox(PhysicsWorld& world)
+{
+    world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3(0.0, -3.0, 0.0), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+    world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3(5.0, 2.0, 0.0), Quaternion(Eigen::AngleAxisd(DegreesToRadians(90.0), Vector3(0.0, 0.0, 1.0))), 1.0, PhysicsLayer::STATIC);
+    world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3(-5.0, 2.0, 0.0), Quaternion(Eigen::AngleAxisd(DegreesToRadians(-90.0), Vector3(0.0, 0.0, 1.0))), 1.0, PhysicsLayer::STATIC);
+    world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3(0.0, 2.0, 5.0), Quaternion(Eigen::AngleAxisd(DegreesToRadians(-90.0), Vector3(1.0, 0.0, 0.0))), 1.0, PhysicsLayer::STATIC);
+    world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3(0.0, 2.0, -5.0), Quaternion(Eigen::AngleAxisd(DegreesToRadians(90.0), Vector3(1.0, 0.0, 0.0))), 1.0, PhysicsLayer::STATIC);
+}
+
+// Spheres dropped in layers into the walled box, each layer is a 16x16 grid with a little jitter
+static void BuildSphereRain(PhysicsWorld& world, uint32_t bodies, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    BuildBox(world);
+
+    const uint32_t grid = 16;
+    const Real radius = 0.2;
+    const Real spacing = 9.0 / grid;
+
+    for (uint32_t i = 0; i < bodies; i++)
+    {
+        uint32_t layer = i / (grid * grid);
+        uint32_t x = i % grid;
+        uint32_t z = (i / grid) % grid;
+
+        Vector3 position(-4.5 + (x + 0.5) * spacing + RandomRange(rng, -0.05, 0.05), layer * spacing, -4.5 + (z + 0.5) * spacing + RandomRange(rng, -0.05, 0.05));
+        BodyID id = world.createBody(PhysicsShape::MakeSphere(radius), PhysicsMaterial{ .restitution = 0.3 }, position, 1.0, PhysicsLayer::DYNAMIC);
+        world.setLinearVelocity(id, Vector3(RandomRange(rng, -1.0, 1.0), RandomRange(rng, -2.0, 0.0), RandomRange(rng, -1.0, 1.0)));
+    }
+}
+
+// Rows of 2D pyramids (base of 10 boxes each) side by side on one big ground plane
+static void BuildBoxPyramids(PhysicsWorld& world, uint32_t bodies, uint32_t seed)
+{
+    const uint32_t base = 10;
+    const uint32_t pyramid_boxes = base * (base + 1) / 2;
+    const uint32_t pyramids = (bodies + pyramid_boxes - 1) / pyramid_boxes;
+    const uint32_t pyramids_per_row = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<Real>(pyramids))));
+
+    const Real half_extent = 0.5;
+    const Real gap = 0.05;
+    const Real pyramid_spacing = base * (2.0 * half_extent + gap) + 2.0;
+
+    Real ground = pyramids_per_row * pyramid_spacing + 10.0;
+    world.createBody(PhysicsShape::MakePlane(Vector2(ground, ground)), Vector3::Zero(), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    uint32_t created = 0;
+    for (uint32_t p = 0; p < pyramids && created < bodies; p++)
+    {
+        Vector3 origin(((p % pyramids_per_row) - 0.5 * pyramids_per_row) * pyramid_spacing, 0.0, ((p / pyramids_per_row) - 0.5 * pyramids_per_row) * pyramid_spacing);
+        for (uint32_t row = 0; row < base && created < bodies; row++)
+        {
+            for (uint32_t column = 0; column < base - row && created < bodies; column++)
+            {
+                Real x = (column + 0.5 * row) * (2.0 * half_extent + gap);
+                Real y = half_extent + row * 2.0 * half_extent;
+                world.createBody(PhysicsShape::MakeOBB(Vector3::Constant(half_extent)), PhysicsMaterial{ .restitution = 0.0 }, origin + Vector3(x, y, 0.0), 1.0, PhysicsLayer::DYNAMIC);
+                created++;
+            }
+        }
+    }
+}
+
+// Randomly sized spheres and rotated boxes falling in columns onto a ground plane
+static void BuildMixedPile(PhysicsWorld& world, uint32_t bodies, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+
+    const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(bodies / 8.0)));
+    const Real spacing = 1.5;
+
+    Real ground = columns * spacing + 10.0;
+    world.createBody(PhysicsShape::MakePlane(Vector2(ground, ground)), Vector3::Zero(), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    for (uint32_t i = 0; i < bodies; i++)
+    {
+        uint32_t column = i % (columns * columns);
+        uint32_t height = i / (columns * columns);
+        Vector3 position(((column % columns) - 0.5 * columns) * spacing, 1.0 + height * spacing, ((column / columns) - 0.5 * columns) * spacing);
+
+        PhysicsMaterial material{ .restitution = 0.2 };
+        if (rng() % 2 == 0)
+        {
+            world.createBody(PhysicsShape::MakeSphere(RandomRange(rng, 0.2, 0.6)), material, position, 1.0, PhysicsLayer::DYNAMIC);
+        }
+        else
+        {
+            Vector3 half_extent(RandomRange(rng, 0.2, 0.6), RandomRange(rng, 0.2, 0.6), RandomRange(rng, 0.2, 0.6));
+            world.createBody(PhysicsShape::MakeOBB(half_extent), material, position, RandomOrientation(rng), 1.0, PhysicsLayer::DYNAMIC);
+        }
+    }
+}
+
+// Chains of 20 links hanging sideways from static anchors, so they swing down and the ends drag over the ground. Every body is held by one joint
+// (ball joints, with every fourth a hinge about z)
+static void BuildJointChains(PhysicsWorld& world, uint32_t bodies, uint32_t seed)
+{
+    const uint32_t chain_length = 20;
+    const uint32_t chains = (bodies + chain_length - 1) / chain_length;
+    const uint32_t chains_per_row = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<Real>(chains))));
+
+    const Vector3 half_extent(0.125, 0.05, 0.05);
+    const Real spacing = 1.0;
+
+    Real ground = chains_per_row * spacing + 20.0;
+    world.createBody(PhysicsShape::MakePlane(Vector2(ground, ground)), Vector3::Zero(), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    uint32_t created = 0;
+    for (uint32_t c = 0; c < chains && created < bodies; c++)
+    {
+        Vector3 anchor(((c % chains_per_row) - 0.5 * chains_per_row) * spacing, 4.0, ((c / chains_per_row) - 0.5 * chains_per_row) * spacing);
+        BodyID previous = world.createBody(PhysicsShape::MakeSphere(0.05), anchor, 1.0, PhysicsLayer::STATIC);
+
+        for (uint32_t l = 0; l < chain_length && created < bodies; l++)
+        {
+            Vector3 joint = anchor + Vector3(2.0 * half_extent[0] * l, 0.0, 0.0);
+            BodyID link = world.createBody(PhysicsShape::MakeOBB(half_extent), PhysicsMaterial{ .restitution = 0.0 }, joint + Vector3(half_extent[0], 0.0, 0.0), 1.0, PhysicsLayer::DYNAMIC);
+            if (l % 4 == 3)
+            {
+                world.createHingeJoint(previous, link, joint, Vector3(0.0, 0.0, 1.0));
+            }
+            else
+            {
+                world.createBallJoint(previous, link, joint);
+            }
+            previous = link;
+            created++;
+        }
+    }
+}
+
+// Randomly sized boxes thrown up over a ground plane while spinning fast about random axes, mostly free flight (the case --integrator is for)
+// Fast enough on thin enough boxes that the explicit integrator gains energy until some of them blow up (the world stops those, see
+// stopped_bodies), which the implicit and symplectic ones don't. The wide ground keeps boxes that tumble off the edge from falling forever
+static void BuildSpinningDebris(PhysicsWorld& world, uint32_t bodies, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+
+    const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<Real>(bodies))));
+    const Real spacing = 3.0;
+
+    Real ground = columns * spacing + 30.0;
+    world.createBody(PhysicsShape::MakePlane(Vector2(ground, ground)), Vector3::Zero(), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    for (uint32_t i = 0; i < bodies; i++)
+    {
+        Vector3 position(((i % columns) - 0.5 * columns) * spacing, RandomRange(rng, 2.0, 6.0), ((i / columns) - 0.5 * columns) * spacing);
+        Vector3 half_extent(RandomRange(rng, 0.05, 0.2), RandomRange(rng, 0.2, 0.5), RandomRange(rng, 0.5, 1.0));
+        BodyID id = world.createBody(PhysicsShape::MakeOBB(half_extent), PhysicsMaterial{ .restitution = 0.2 }, position, RandomOrientation(rng), 1.0, PhysicsLayer::DYNAMIC);
+        world.setLinearVelocity(id, Vector3(RandomRange(rng, -1.0, 1.0), RandomRange(rng, 2.0, 6.0), RandomRange(rng, -1.0, 1.0)));
+        world.setAngularVelocity(id, Vector3(RandomRange(rng, -30.0, 30.0), RandomRange(rng, -30.0, 30.0), RandomRange(rng, -30.0, 30.0)));
+    }
+}
+
+const std::vector<BenchScene>& GetBenchScenes()
+{
+    static const std::vector<BenchScene> scenes = {
+        { "sphere_rain", "Spheres falling into the bouncing_sphere box", BuildSphereRain },
+        { "box_pyramids", "2D box pyramids resting on a ground plane", BuildBoxPyramids },
+        { "mixed_pile", "Random spheres and rotated boxes piling up on a ground plane", BuildMixedPile },
+        { "joint_chains", "Jointed chains swinging down from static anchors onto a ground plane", BuildJointChains },
+        { "spinning_debris", "Fast spinning boxes thrown up over a ground plane", BuildSpinningDebris },
+    };
+    return scenes;
+}
+
+const BenchScene* FindBenchScene(const std::string& name)
+{
+    for (const BenchScene& scene : GetBenchScenes())
+    {
+        if (name == scene.name) return &scene;
+    }
+    return nullptr;
+}
+
+static const char* integrator_names[] = { "explicit", "implicit", "symplectic" };
+
+bool ParseIntegrator(const std::string& name, Integrator& integrator)
+{
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        if (name == integrator_names[i])
+        {
+            integrator = static_cast<Integrator>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+BenchResult RunBenchScene(const BenchScene& scene, uint32_t bodies, uint32_t steps, uint32_t warmup_steps, Real delta, uint32_t substeps, Integrator integrator)
+{
+    BenchResult result;
+    result.scene = scene.name;
+    result.bodies = bodies;
+    result.steps = steps;
+    result.delta = delta;
+    result.substeps = substeps;
+    result.integrator = integrator;
+
+    PhysicsWorld world;
+    world.setGravity({ 0.0, 0.0, 0.0, 0.0, -9.8, 0.0 });
+    world.setAllocationCounter(GetAllocationCount);
+    world.setSubsteps(substeps);
+    world.setIntegrator(integrator);
+    scene.build(world, bodies, 1234);
+
+    for (uint32_t i = 0; i < warmup_steps; i++)
+    {
+        world.update(delta);
+    }
+
+    for (uint32_t i = 0; i < steps; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        world.update(delta);
+        result.wall_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // The profiler only keeps a short window so sum up every step here (outside the timed part)
+        StepSample sample = world.getStepStats().last;
+        for (uint32_t j = 0; j < NUM_STEP_PHASES; j++)
+        {
+            result.phase_time[j] += sample.phase_time[j];
+        }
+        result.contacts += sample.contacts;
+        result.allocations += sample.allocations;
+        result.pairs_tested += sample.pairs_tested;
+        result.stopped_bodies += sample.stopped_bodies;
+    }
+
+    if (steps > 0)
+    {
+        result.steps_per_second = (result.wall_time > 0.0) ? steps / result.wall_time : 0.0;
+        result.contacts /= steps;
+        result.pairs_tested /= steps;
+        result.allocations /= steps;
+    }
+    result.peak_memory = GetPeakMemory();
+
+    return result;
+}
+
+uint64_t GetPeakMemory()
+{
+#if defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<uint64_t>(usage.ru_maxrss);  // Bytes on macOS
+#elif defined(__unix__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // Kilobytes on Linux
+#else
+    return 0;
+#endif
+}
+
+void WriteBenchText(std::ostream& out, const BenchResult& result)
+{
+    out << result.scene << " (" << result.bodies << " bodies, " << result.steps << " steps" << (result.substeps > 1 ? ", " + std::to_string(result.substeps) + " substeps" : "")
+        << (result.integrator != Integrator::EXPLICIT_EULER ? std::string(", ") + integrator_names[result.integrator] + " integrator" : "") << "): "
+        << result.steps_per_second << " steps/s, " << result.contacts << " contacts/step, " << result.allocations << " allocations/step, peak memory " << result.peak_memory / (1024 * 1024) << " MiB"
+        << (result.stopped_bodies > 0 ? ", " + std::to_string(result.stopped_bodies) + " bodies stopped (non finite)" : "") << "\n";
+
+    for (uint32_t i = 0; i < NUM_STEP_PHASES; i++)
+    {
+        double per_step = (result.steps > 0) ? result.phase_time[i] / result.steps : 0.0;
+        out << "    " << GetStepPhaseName(static_cast<StepPhase>(i)) << ": " << per_step * 1000.0 << " ms/step\n";
+    }
+}
+
+// "Integrate Velocities" -> "integrate_velocities"
+static std::string GetPhaseKey(StepPhase phase)
+{
+    std::string key = GetStepPhaseName(phase);
+    for (char& c : key)
+    {
+        c = (c == ' ') ? '_' : static_cast<char>(std::tolower(c));
+    }
+    return key;
+}
+
+void WriteBenchJson(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "{\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"scene\": \"" << result.scene << "\",\n";
+        out << "      \"bodies\": " << result.bodies << ",\n";
+        out << "      \"steps\": " << result.steps << ",\n";
+        out << "      \"delta\": " << result.delta << ",\n";
+        out << "      \"substeps\": " << result.substeps << ",\n";
+        out << "      \"integrator\": \"" << integrator_names[result.integrator] << "\",\n";
+        out << "      \"wall_time\": " << result.wall_time << ",\n";
+        out << "      \"steps_per_second\": " << result.steps_per_second << ",\n";
+        out << "      \"contacts_per_step\": " << result.contacts << ",\n";
+        out << "      \"pairs_per_step\": " << result.pairs_tested << ",\n";
+        out << "      \"allocations_per_step\": " << result.allocations << ",\n";
+        out << "      \"stopped_bodies\": " << result.stopped_bodies << ",\n";
+        out << "      \"peak_memory\": " << result.peak_memory << ",\n";
+        out << "      \"phase_time\": {";
+        for (uint32_t j = 0; j < NUM_STEP_PHASES; j++)
+        {
+            out << (j == 0 ? "" : ", ") << "\"" << GetPhaseKey(static_cast<StepPhase>(j)) << "\": " << result.phase_time[j];
+        }
+        out << "}\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
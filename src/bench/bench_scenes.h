@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <physics/physics.h>
+
+/*
+    Standard scenes for the headless benchmarks.
+    Every scene is built from a fixed seed so runs with the same parameters simulate the same thing.
+*/
+
+struct BenchScene
+{
+    const char* name;
+    const char* description;
+    void (*build)(PhysicsWorld& world, uint32_t bodies, uint32_t seed);
+};
+
+const std::vector<BenchScene>& GetBenchScenes();
+const BenchScene* FindBenchScene(const std::string& name);
+
+struct BenchResult
+{
+    std::string scene;
+    uint32_t bodies = 0;
+    uint32_t steps = 0;
+    double delta = 0.0;
+    uint32_t substeps = 1;
+    Integrator integrator = Integrator::EXPLICIT_EULER;
+
+    double wall_time = 0.0;       // Seconds for all measured steps
+    double steps_per_second = 0.0;
+
+    // Summed over the measured steps (seconds)
+    double phase_time[NUM_STEP_PHASES] = {};
+
+    // Per step averages
+    double contacts = 0.0;
+    double pairs_tested = 0.0;
+    double allocations = 0.0;
+
+    // Summed over the measured steps, bodies the world had to stop because they went non finite (see StepSample)
+    uint32_t stopped_bodies = 0;
+
+    // Bytes, 0 when the platform doesn't report it
+    uint64_t peak_memory = 0;
+};
+
+BenchResult RunBenchScene(const BenchScene& scene, uint32_t bodies, uint32_t steps, uint32_t warmup_steps, Real delta, uint32_t substeps = 1, Integrator integrator = Integrator::EXPLICIT_EULER);
+
+// "explicit", "implicit" or "symplectic", false for anything else
+bool ParseIntegrator(const std::string& name, Integrator& integrator);
+
+uint64_t GetPeakMemory();
+
+// Heap allocations made by this process so far (counted by replacing the global operator new)
+uint64_t GetAllocationCount();
+
+void WriteBenchText(std::ostream& out, const BenchResult& result);
+void WriteBenchJson(std::ostream& out, const std::vector<BenchResult>& results);
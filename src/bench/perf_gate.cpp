@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_scenes.h"
+
+/*
+    Performance regression gate, registered with CTest when PHYSICS_PERF_TESTS is on.
+    Runs the headless scenes listed in a baseline file and fails if steps/sec dropped or allocations per step grew past the tolerance.
+
+    physics_perf_gate --baseline <file> [--scene <name>] [--tolerance 0.25] [--allocation-tolerance 0.1] [--repeat 3] [--report <file>] [--update]
+
+    Baseline lines are "scene bodies steps steps_per_second allocations_per_step", # starts a comment.
+    Throughput depends on the machine so baselines should be regenerated with --update on the machine that runs the gate.
+*/
+
+struct BaselineEntry
+{
+    std::string scene;
+    uint32_t bodies = 0;
+    uint32_t steps = 0;
+    double steps_per_second = 0.0;
+    double allocations = 0.0;
+};
+
+static bool ReadBaseline(const std::string& path, std::vector<BaselineEntry>& entries)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::stringstream stream(line);
+
+        BaselineEntry entry;
+        if (!(stream >> entry.scene)) continue;
+        if (!(stream >> entry.bodies >> entry.steps >> entry.steps_per_second >> entry.allocations))
+        {
+            std::cerr << "Bad baseline line: " << line << "\n";
+            return false;
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+static bool WriteBaseline(const std::string& path, const std::vector<BaselineEntry>& entries)
+{
+    std::ofstream file(path);
+    if (!file) return false;
+
+    file << "# Perf regression baseline for physics_perf_gate (regenerate with --update on the machine that runs the gate)\n";
+    file << "# scene bodies steps steps_per_second allocations_per_step\n";
+    for (const BaselineEntry& entry : entries)
+    {
+        file << entry.scene << " " << entry.bodies << " " << entry.steps << " " << std::fixed << std::setprecision(2) << entry.steps_per_second << " " << entry.allocations << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+// Positive when the measurement is worse than the baseline
+static double GetRegression(double baseline, double measured, bool higher_is_better)
+{
+    if (baseline <= 0.0) return (!higher_is_better && measured > 0.0) ? 1.0 : 0.0;
+
+    double regression = higher_is_better ? (baseline - measured) / baseline : (measured - baseline) / baseline;
+    return (std::abs(regression) < 1e-6) ? 0.0 : regression;  // Avoids printing -0.00%
+}
+
+int main(int argc, char** argv)
+{
+    std::string baseline_path;
+    std::string scene_filter;
+    std::string report_path;
+    double tolerance = 0.25;
+    double allocation_tolerance = 0.1;
+    uint32_t repeat = 3;
+    bool update = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--baseline" && has_value) baseline_path = argv[++i];
+        else if (arg == "--scene" && has_value) scene_filter = argv[++i];
+        else if (arg == "--tolerance" && has_value) tolerance = std::stod(argv[++i]);
+        else if (arg == "--allocation-tolerance" && has_value) allocation_tolerance = std::stod(argv[++i]);
+        else if (arg == "--repeat" && has_value) repeat = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        else if (arg == "--report" && has_value) report_path = argv[++i];
+        else if (arg == "--update") update = true;
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 2;
+        }
+    }
+
+    std::vector<BaselineEntry> entries;
+    if (baseline_path.empty() || !ReadBaseline(baseline_path, entries))
+    {
+        std::cerr << "Couldn't read baseline file '" << baseline_path << "'\n";
+        return 2;
+    }
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "Perf gate: tolerance " << tolerance * 100.0 << "% steps/s, " << allocation_tolerance * 100.0 << "% allocations, best of " << repeat << "\n";
+
+    bool failed = false;
+    uint32_t checked = 0;
+    for (BaselineEntry& entry : entries)
+    {
+        if (!scene_filter.empty() && entry.scene != scene_filter) continue;
+
+        const BenchScene* scene = FindBenchScene(entry.scene);
+        if (scene == nullptr)
+        {
+            report << entry.scene << ": unknown scene\n";
+            failed = true;
+            continue;
+        }
+
+        // Best of several runs filters out most of the noise from other processes
+        BenchResult best;
+        for (uint32_t i = 0; i < repeat; i++)
+        {
+            BenchResult result = RunBenchScene(*scene, entry.bodies, entry.steps, 10, 1.0 / 60.0);
+            if (i == 0 || result.steps_per_second > best.steps_per_second) best = result;
+        }
+        checked++;
+
+        if (update)
+        {
+            entry.steps_per_second = best.steps_per_second;
+            entry.allocations = best.allocations;
+            report << entry.scene << " " << entry.bodies << ": " << best.steps_per_second << " steps/s, " << best.allocations << " allocations/step (updated)\n";
+            continue;
+        }
+
+        double speed_regression = GetRegression(entry.steps_per_second, best.steps_per_second, true);
+        double allocation_regression = GetRegression(entry.allocations, best.allocations, false);
+        bool slower = speed_regression > tolerance;
+        bool more_allocations = allocation_regression > allocation_tolerance;
+        failed |= slower || more_allocations;
+
+        report << entry.scene << " " << entry.bodies << " bodies x " << entry.steps << " steps\n";
+        report << "    steps/s:          " << std::setw(12) << entry.steps_per_second << " -> " << std::setw(12) << best.steps_per_second
+               << "  (" << std::showpos << (0.0 - speed_regression) * 100.0 << std::noshowpos << "%)" << (slower ? "  REGRESSION" : (speed_regression < -tolerance ? "  faster, consider updating the baseline" : "")) << "\n";
+        report << "    allocations/step: " << std::setw(12) << entry.allocations << " -> " << std::setw(12) << best.allocations
+               << "  (" << std::showpos << allocation_regression * 100.0 << std::noshowpos << "%)" << (more_allocations ? "  REGRESSION" : "") << "\n";
+    }
+
+    if (checked == 0 && !scene_filter.empty())
+    {
+        report << "No baseline entries for scene '" << scene_filter << "'\n";
+        failed = true;
+    }
+
+    if (update)
+    {
+        if (!WriteBaseline(baseline_path, entries))
+        {
+            std::cerr << "Couldn't write baseline file '" << baseline_path << "'\n";
+            return 2;
+        }
+        failed = false;
+    }
+    else
+    {
+        report << (failed ? "FAILED" : "PASSED") << "\n";
+    }
+
+    std::cout << report.str();
+    if (!report_path.empty())
+    {
+        std::ofstream file(report_path);
+        file << report.str();
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
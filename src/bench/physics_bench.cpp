@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_scenes.h"
+
+/*
+    Headless throughput benchmark, only links physics_lib so it runs on machines without a GPU.
+
+    physics_bench [--scene <name|all>] [--bodies 1000,10000,100000] [--steps 300] [--warmup 10] [--delta 0.0166667] [--substeps 1] [--integrator explicit] [--json <path|->]
+*/
+
+static void PrintUsage()
+{
+    std::cout << "Usage: physics_bench [--scene <name|all>] [--bodies N[,N...]] [--steps N] [--warmup N] [--delta seconds] [--substeps N] [--integrator explicit|implicit|symplectic] [--json <path|->] [--list]\n";
+}
+
+static std::vector<uint32_t> ParseBodyCounts(const std::string& list)
+{
+    std::vector<uint32_t> counts;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty()) counts.push_back(static_cast<uint32_t>(std::stoul(item)));
+    }
+    return counts;
+}
+
+int main(int argc, char** argv)
+{
+    std::string scene_name = "all";
+    std::vector<uint32_t> body_counts = { 1000 };
+    uint32_t steps = 300;
+    uint32_t warmup_steps = 10;
+    Real delta = 1.0 / 60.0;
+    uint32_t substeps = 1;
+    Integrator integrator = Integrator::EXPLICIT_EULER;
+    std::string json_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--list")
+        {
+            for (const BenchScene& scene : GetBenchScenes())
+            {
+                std::cout << scene.name << ": " << scene.description << "\n";
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            PrintUsage();
+            return EXIT_SUCCESS;
+        }
+        else if (arg == "--scene" && has_value) scene_name = argv[++i];
+        else if (arg == "--bodies" && has_value) body_counts = ParseBodyCounts(argv[++i]);
+        else if (arg == "--steps" && has_value) steps = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--warmup" && has_value) warmup_steps = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--delta" && has_value) delta = std::stod(argv[++i]);
+        else if (arg == "--substeps" && has_value) substeps = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--integrator" && has_value)
+        {
+            if (!ParseIntegrator(argv[++i], integrator))
+            {
+                std::cerr << "Unknown integrator: " << argv[i] << "\n";
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--json" && has_value) json_path = argv[++i];
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<const BenchScene*> scenes;
+    if (scene_name == "all")
+    {
+        for (const BenchScene& scene : GetBenchScenes())
+        {
+            scenes.push_back(&scene);
+        }
+    }
+    else if (const BenchScene* scene = FindBenchScene(scene_name))
+    {
+        scenes.push_back(scene);
+    }
+    else
+    {
+        std::cerr << "Unknown scene: " << scene_name << " (use --list)\n";
+        return EXIT_FAILURE;
+    }
+
+    // Human readable output goes to stderr when the JSON is written to stdout so the two don't mix
+    std::ostream& log = (json_path == "-") ? std::cerr : std::cout;
+
+    std::vector<BenchResult> results;
+    for (const BenchScene* scene : scenes)
+    {
+        for (uint32_t bodies : body_counts)
+        {
+            BenchResult result = RunBenchScene(*scene, bodies, steps, warmup_steps, delta, substeps, integrator);
+            WriteBenchText(log, result);
+            results.push_back(result);
+        }
+    }
+
+    if (json_path == "-")
+    {
+        WriteBenchJson(std::cout, results);
+    }
+    else if (!json_path.empty())
+    {
+        std::ofstream file(json_path);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << json_path << "\n";
+            return EXIT_FAILURE;
+        }
+        WriteBenchJson(file, results);
+    }
+
+    return EXIT_SUCCESS;
+}
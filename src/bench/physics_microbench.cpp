@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <physics/physics.h>
+#include <physics/dynamics.h>
+#include <physics/triangle_mesh.h>
+#include <physics/heightfield.h>
+
+/*
+    Microbenchmarks for the hot kernels: every narrowphase function, the rigid body dynamics, inertia setup, the velocity solver and getWorldMatrix.
+    Collision benchmarks take the percentage of test poses that overlap as their argument so hit and miss paths can be measured separately.
+*/
+
+// Friend of PhysicsWorld so the private kernels can be called directly
+struct PhysicsBenchAccess
+{
+    using CollisionFunc = PhysicsWorld::CollisionFunc;
+
+    static CollisionFunc sphereSphere() { return PhysicsWorld::checkSphereSphereCollision; }
+    static CollisionFunc spherePlane() { return PhysicsWorld::checkSpherePlaneCollision; }
+    static CollisionFunc sphereOBB() { return PhysicsWorld::checkSphereOBBCollision; }
+    static CollisionFunc planePlane() { return PhysicsWorld::checkPlanePlaneCollision; }
+    static CollisionFunc planeOBB() { return PhysicsWorld::checkPlaneOBBCollision; }
+    static CollisionFunc obbOBB() { return PhysicsWorld::checkOBBOBBCollision; }
+    static CollisionFunc sphereMesh() { return PhysicsWorld::checkSphereMeshCollision; }
+    static CollisionFunc obbMesh() { return PhysicsWorld::checkOBBMeshCollision; }
+    static CollisionFunc sphereHeightField() { return PhysicsWorld::checkSphereHeightFieldCollision; }
+    static CollisionFunc obbHeightField() { return PhysicsWorld::checkOBBHeightFieldCollision; }
+
+    static CollisionQuery checkCollision(PhysicsWorld& world, BodyID a, BodyID b) { return world.checkCollision(&world.bodies[a], &world.bodies[b]); }
+    static void prepareSolverBodies(PhysicsWorld& world) { world.prepareSolverBodies(); }
+    static void prepareCollisionVelocities(PhysicsWorld& world, Collision& collision) { world.prepareCollisionVelocities(collision); }
+    static void handleCollisionVelocities(PhysicsWorld& world, Collision& collision, Real delta) { world.handleCollisionVelocities(collision, delta); }
+};
+
+using CollisionFunc = PhysicsBenchAccess::CollisionFunc;
+
+static Real RandomRange(std::mt19937& rng, Real min, Real max)
+{
+    return min + (max - min) * (static_cast<Real>(rng()) / static_cast<Real>(std::mt19937::max()));
+}
+
+static Quaternion RandomOrientation(std::mt19937& rng)
+{
+    Quaternion q(RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0));
+    if (q.squaredNorm() < 1e-6) return Quaternion::Identity();
+    return q.normalized();
+}
+
+struct CollisionCase
+{
+    Transform a;
+    Transform b;
+};
+
+// Shape b sits at the origin, shape a is placed randomly inside [-range, range] until the requested share of the poses overlap
+static std::vector<CollisionCase> MakeCollisionCases(CollisionFunc func, const PhysicsShape& a, const PhysicsShape& b, Real range, int64_t hit_percent)
+{
+    const size_t count = 256;
+    size_t wanted_hits = static_cast<size_t>(count * std::clamp<int64_t>(hit_percent, 0, 100) / 100);
+
+    std::mt19937 rng(42);
+    std::vector<CollisionCase> hits, misses;
+    for (uint32_t attempt = 0; attempt < 1000000 && (hits.size() < wanted_hits || misses.size() < count - wanted_hits); attempt++)
+    {
+        CollisionCase test;
+        test.a.position = Vector3(RandomRange(rng, -range, range), RandomRange(rng, -range, range), RandomRange(rng, -range, range));
+        test.a.orientation = RandomOrientation(rng);
+
+        bool colliding = func(&a, &test.a, &b, &test.b).colliding;
+        if (colliding && hits.size() < wanted_hits) hits.push_back(test);
+        if (!colliding && misses.size() < count - wanted_hits) misses.push_back(test);
+    }
+
+    // Interleave so the branch predictor sees the real mix instead of one long run of each
+    std::vector<CollisionCase> cases = hits;
+    cases.insert(cases.end(), misses.begin(), misses.end());
+    std::shuffle(cases.begin(), cases.end(), rng);
+    return cases;
+}
+
+static void RunCollisionBenchmark(benchmark::State& state, CollisionFunc func, const PhysicsShape& a, const PhysicsShape& b, Real range)
+{
+    std::vector<CollisionCase> cases = MakeCollisionCases(func, a, b, range, state.range(0));
+    if (cases.empty())
+    {
+        // The kernel never hit or never missed inside range, so there's no pose to cycle through
+        state.SkipWithError("no collision cases could be generated");
+        return;
+    }
+
+    size_t hits = 0;
+    size_t index = 0;
+    for (auto _ : state)
+    {
+        const CollisionCase& test = cases[index];
+        CollisionQuery result = func(&a, &test.a, &b, &test.b);
+        benchmark::DoNotOptimize(result);
+
+        hits += result.colliding ? 1 : 0;
+        index = (index + 1) % cases.size();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["hit_ratio"] = static_cast<double>(hits) / std::max<int64_t>(state.iterations(), 1);
+}
+
+// Bumpy 32x32 grid used by both the mesh and heightfield benchmarks
+static std::vector<Real> GetTerrainHeights(uint32_t size)
+{
+    std::vector<Real> heights(size * size);
+    for (uint32_t z = 0; z < size; z++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            heights[z * size + x] = 0.5 * std::sin(x * 0.4) * std::cos(z * 0.3);
+        }
+    }
+    return heights;
+}
+
+static const TriangleMesh& GetTerrainMesh()
+{
+    static const TriangleMesh mesh = [] {
+        const uint32_t size = 32;
+        std::vector<Real> heights = GetTerrainHeights(size);
+
+        std::vector<Vector3> vertices;
+        std::vector<uint32_t> indices;
+        for (uint32_t z = 0; z < size; z++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                vertices.push_back(Vector3(x - size * 0.5, heights[z * size + x], z - size * 0.5));
+            }
+        }
+        for (uint32_t z = 0; z + 1 < size; z++)
+        {
+            for (uint32_t x = 0; x + 1 < size; x++)
+            {
+                uint32_t i = z * size + x;
+                indices.insert(indices.end(), { i, i + size, i + 1, i + 1, i + size, i + size + 1 });
+            }
+        }
+        return TriangleMesh(vertices, indices);
+    }();
+    return mesh;
+}
+
+static const HeightField& GetTerrainHeightField()
+{
+    static const HeightField field(32, 32, Vector2(1.0, 1.0), GetTerrainHeights(32));
+    return field;
+}
+
+static void BM_SphereSphere(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::sphereSphere(), PhysicsShape::MakeSphere(1.0), PhysicsShape::MakeSphere(1.0), 3.0);
+}
+
+static void BM_SpherePlane(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::spherePlane(), PhysicsShape::MakeSphere(1.0), PhysicsShape::MakePlane(Vector2(10.0, 10.0)), 3.0);
+}
+
+static void BM_SphereOBB(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::sphereOBB(), PhysicsShape::MakeSphere(1.0), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), 2.5);
+}
+
+static void BM_PlanePlane(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::planePlane(), PhysicsShape::MakePlane(Vector2(10.0, 10.0)), PhysicsShape::MakePlane(Vector2(10.0, 10.0)), 3.0);
+}
+
+static void BM_PlaneOBB(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::planeOBB(), PhysicsShape::MakePlane(Vector2(10.0, 10.0)), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), 2.0);
+}
+
+static void BM_OBBOBB(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::obbOBB(), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), 2.0);
+}
+
+static void BM_SphereMesh(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::sphereMesh(), PhysicsShape::MakeSphere(0.5), PhysicsShape::MakeMesh(&GetTerrainMesh()), 2.0);
+}
+
+static void BM_OBBMesh(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::obbMesh(), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), PhysicsShape::MakeMesh(&GetTerrainMesh()), 2.0);
+}
+
+static void BM_SphereHeightField(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::sphereHeightField(), PhysicsShape::MakeSphere(0.5), PhysicsShape::MakeHeightField(&GetTerrainHeightField()), 2.0);
+}
+
+static void BM_OBBHeightField(benchmark::State& state)
+{
+    RunCollisionBenchmark(state, PhysicsBenchAccess::obbHeightField(), PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), PhysicsShape::MakeHeightField(&GetTerrainHeightField()), 2.0);
+}
+
+// Percentage of poses that overlap
+#define COLLISION_BENCHMARK(name) BENCHMARK(name)->ArgName("hit_percent")->Arg(0)->Arg(50)->Arg(100)
+
+COLLISION_BENCHMARK(BM_SphereSphere);
+COLLISION_BENCHMARK(BM_SpherePlane);
+COLLISION_BENCHMARK(BM_SphereOBB);
+BENCHMARK(BM_PlanePlane)->ArgName("hit_percent")->Arg(0);
+COLLISION_BENCHMARK(BM_PlaneOBB);
+COLLISION_BENCHMARK(BM_OBBOBB);
+COLLISION_BENCHMARK(BM_SphereMesh);
+COLLISION_BENCHMARK(BM_OBBMesh);
+COLLISION_BENCHMARK(BM_SphereHeightField);
+COLLISION_BENCHMARK(BM_OBBHeightField);
+
+static RigidBodyState MakeRigidBodyState()
+{
+    std::mt19937 rng(7);
+    RigidBodyState state;
+    state.spatial_inertia = SpatialInertia::FromMatrix(GetSpatialInertia(PhysicsShape::MakeOBB(Vector3(0.5, 1.0, 1.5)), 2.0));
+    for (int i = 0; i < 6; i++)
+    {
+        state.velocity[i] = RandomRange(rng, -1.0, 1.0);
+    }
+    return state;
+}
+
+static void BM_ForwardDynamics(benchmark::State& state)
+{
+    RigidBodyState rb = MakeRigidBodyState();
+    Vector6 force;
+    force << 0.1, 0.2, 0.3, 0.0, -19.6, 0.0;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(rb.velocity);
+        Vector6 acceleration = calculateForwardDynamics(rb, force);
+        benchmark::DoNotOptimize(acceleration);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ForwardDynamics);
+
+static void BM_InverseDynamics(benchmark::State& state)
+{
+    RigidBodyState rb = MakeRigidBodyState();
+    Vector6 desired;
+    desired << 0.0, 0.0, 1.0, 0.5, 0.0, 0.0;
+    Vector6 external;
+    external << 0.0, 0.0, 0.0, 0.0, -9.8, 0.0;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(rb.velocity);
+        Vector6 force = calculateInverseDynamics(rb, desired, external);
+        benchmark::DoNotOptimize(force);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InverseDynamics);
+
+// Same maths as BM_InverseDynamics over `count` independent bodies per call, compare items/s against it
+static void BM_InverseDynamicsBatch(benchmark::State& state)
+{
+    const uint32_t count = static_cast<uint32_t>(state.range(0));
+    std::mt19937 rng(7);
+
+    std::vector<Real> velocity(6 * count), desired(6 * count), external(6 * count), result(6 * count);
+    for (Real& value : velocity) value = RandomRange(rng, -1.0, 1.0);
+    for (Real& value : desired) value = RandomRange(rng, -1.0, 1.0);
+    for (uint32_t i = 0; i < count; i++) external[4 * count + i] = -9.8;
+
+    SpatialInertia spatial_inertia = MakeRigidBodyState().spatial_inertia;
+    const SymmetricMatrix3& rotational = spatial_inertia.inertia;
+    std::vector<Real> mass(count, spatial_inertia.mass), center(3 * count), inertia(6 * count);
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        std::fill_n(center.begin() + k * count, count, spatial_inertia.center_of_mass[k]);
+    }
+    const Real components[6] = { rotational.xx, rotational.yy, rotational.zz, rotational.xy, rotational.xz, rotational.yz };
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        std::fill_n(inertia.begin() + k * count, count, components[k]);
+    }
+
+    InverseDynamicsBatch batch = { .count = count, .mass = mass.data() };
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        batch.velocity[k] = velocity.data() + k * count;
+        batch.desired_acceleration[k] = desired.data() + k * count;
+        batch.external_acceleration[k] = external.data() + k * count;
+        batch.inertia[k] = inertia.data() + k * count;
+        batch.result[k] = result.data() + k * count;
+    }
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        batch.center_of_mass[k] = center.data() + k * count;
+    }
+
+    for (auto _ : state)
+    {
+        calculateInverseDynamicsBatch(batch);
+        benchmark::DoNotOptimize(result.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_InverseDynamicsBatch)->ArgName("count")->Arg(16)->Arg(1024)->Arg(16384);
+
+// Argument is the shape type
+static void BM_GetSpatialInertia(benchmark::State& state)
+{
+    PhysicsShape shape = (state.range(0) == ShapeType::SPHERE) ? PhysicsShape::MakeSphere(1.0) : PhysicsShape::MakeOBB(Vector3(0.5, 1.0, 1.5));
+    Real mass = 2.0;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(mass);
+        Eigen::Matrix<Real, 6, 6> inertia = GetSpatialInertia(shape, mass);
+        benchmark::DoNotOptimize(inertia);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetSpatialInertia)->ArgName("shape")->Arg(ShapeType::SPHERE)->Arg(ShapeType::OBB);
+
+// A box resting on a plane with its 4 point manifold, one iteration is a full solver pass over the manifold
+static void BM_HandleCollisionVelocities(benchmark::State& state)
+{
+    PhysicsWorld world;
+    BodyID plane = world.createBody(PhysicsShape::MakePlane(Vector2(10.0, 10.0)), Vector3::Zero(), 1.0, PhysicsLayer::STATIC);
+    BodyID box = world.createBody(PhysicsShape::MakeOBB(Vector3(0.5, 0.5, 0.5)), PhysicsMaterial{ .restitution = 0.0 }, Vector3(0.0, 0.49, 0.0), 1.0, PhysicsLayer::DYNAMIC);
+    world.setLinearVelocity(box, Vector3(0.0, -1.0, 0.0));
+    world.setAngularVelocity(box, Vector3(0.1, 0.0, 0.2));
+
+    CollisionQuery result = PhysicsBenchAccess::checkCollision(world, plane, box);
+    std::vector<Collision> collisions;
+    for (uint32_t i = 0; i < result.contact_count; i++)
+    {
+        collisions.push_back(Collision{ .a = plane, .b = box, .norm = result.norm, .depth = result.contacts[i].depth, .point = result.contacts[i].point });
+    }
+
+    PhysicsBenchAccess::prepareSolverBodies(world);
+    for (Collision& collision : collisions)
+    {
+        PhysicsBenchAccess::prepareCollisionVelocities(world, collision);
+    }
+
+    for (auto _ : state)
+    {
+        for (Collision& collision : collisions)
+        {
+            PhysicsBenchAccess::handleCollisionVelocities(world, collision, 1.0 / 60.0);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * collisions.size());
+}
+BENCHMARK(BM_HandleCollisionVelocities);
+
+static void BM_GetWorldMatrix(benchmark::State& state)
+{
+    std::mt19937 rng(3);
+    PhysicsWorld world;
+    const BodyID count = 1024;
+    for (BodyID i = 0; i < count; i++)
+    {
+        Vector3 position(RandomRange(rng, -10.0, 10.0), RandomRange(rng, -10.0, 10.0), RandomRange(rng, -10.0, 10.0));
+        world.createBody(PhysicsShape::MakeSphere(0.5), position, RandomOrientation(rng), 1.0, PhysicsLayer::DYNAMIC);
+    }
+
+    BodyID id = 0;
+    for (auto _ : state)
+    {
+        Matrix4 matrix = world.getWorldMatrix(id);
+        benchmark::DoNotOptimize(matrix);
+        id = (id + 1) % count;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetWorldMatrix);
+
+BENCHMARK_MAIN();
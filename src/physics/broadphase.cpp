@@ -0,0 +1,200 @@
+/*
+    Uniform grid broadphase.
+
+    Every body gets a world space bounding box (grown by how far it can move this step when speculative contacts are on) and is listed
+    once for every grid cell the box touches. The list is sorted by cell, so the bodies sharing a cell end up next to each other and only
+    those get tested against each other. A pair sharing several cells is only kept in the cell holding the min corner of the two boxes'
+    overlap, so it comes out once.
+    The cells are sized off the dynamic bodies. Anything covering lots of cells (a ground plane, terrain) is kept out of the grid and
+    tested against everything instead.
+    That's O(n log n) plus the bodies sharing cells instead of the n^2 / 2 pairs of the brute force loop, and nothing but the overlapping
+    pairs is kept. Bodies with a non finite transform are left out entirely, a NaN box overlaps everything and would otherwise drag the
+    whole world into the narrowphase with it.
+*/
+
+#include "physics.h"
+#include "dynamics.h"
+#include "triangle_mesh.h"
+#include "heightfield.h"
+#include <algorithm>
+
+struct BroadphaseBounds
+{
+    Vector3 min;
+    Vector3 max;
+};
+
+struct CellEntry
+{
+    uint64_t cell;
+    BodyID id;
+};
+
+// 21 bits a coordinate so a cell fits a 64 bit key, anything further out is clamped into the last cell (still correct, just more tests)
+static const int64_t CELL_LIMIT = (1 << 20) - 1;
+static const uint64_t MAX_BODY_CELLS = 64;
+
+static int64_t GetCell(Real coordinate, Real inverse_cell_size)
+{
+    return static_cast<int64_t>(std::clamp(std::floor(coordinate * inverse_cell_size), static_cast<Real>(-CELL_LIMIT), static_cast<Real>(CELL_LIMIT)));
+}
+
+static uint64_t GetCellKey(int64_t x, int64_t y, int64_t z)
+{
+    return (static_cast<uint64_t>(x + CELL_LIMIT) << 42) | (static_cast<uint64_t>(y + CELL_LIMIT) << 21) | static_cast<uint64_t>(z + CELL_LIMIT);
+}
+
+static BroadphaseBounds GetLocalBounds(const PhysicsShape& shape)
+{
+    switch (shape.type)
+    {
+        case ShapeType::SPHERE:
+            return BroadphaseBounds{ .min = Vector3::Constant(-shape.sphere.radius), .max = Vector3::Constant(shape.sphere.radius) };
+        case ShapeType::PLANE:
+        {
+            Vector3 half_extent(shape.plane.extent[0] * 0.5, 0.0, shape.plane.extent[1] * 0.5);
+            return BroadphaseBounds{ .min = -half_extent, .max = half_extent };
+        }
+        case ShapeType::OBB:
+            return BroadphaseBounds{ .min = -shape.obb.half_extent, .max = shape.obb.half_extent };
+        case ShapeType::MESH:
+            return BroadphaseBounds{ .min = shape.mesh.mesh->getBoundsMin(), .max = shape.mesh.mesh->getBoundsMax() };
+        case ShapeType::HEIGHTFIELD:
+        {
+            const HeightField* field = shape.heightfield.field;
+            HeightRange range = field->getBounds();
+            Vector3 first = field->getVertex(0, 0);
+            Vector3 last = field->getVertex(field->getColumns() - 1, field->getRows() - 1);
+            return BroadphaseBounds{ .min = Vector3(first[0], range.min, first[2]), .max = Vector3(last[0], range.max, last[2]) };
+        }
+        default:
+            return BroadphaseBounds{ .min = Vector3::Zero(), .max = Vector3::Zero() };
+    }
+}
+
+static BroadphaseBounds GetWorldBounds(const PhysicsShape& shape, const Transform& transform, Real margin)
+{
+    BroadphaseBounds local = GetLocalBounds(shape);
+
+    // Box around the rotated local box: the center rotates, the half extents go through |R|
+    Matrix3 rotation = transform.orientation.toRotationMatrix();
+    Vector3 center = transform.position + rotation * ((local.min + local.max) * 0.5);
+    Vector3 half_extent = rotation.cwiseAbs() * ((local.max - local.min) * 0.5) + Vector3::Constant(margin);
+    return BroadphaseBounds{ .min = center - half_extent, .max = center + half_extent };
+}
+
+static bool IsOverlapping(const BroadphaseBounds& a, const BroadphaseBounds& b)
+{
+    return (a.min.array() <= b.max.array()).all() && (b.min.array() <= a.max.array()).all();
+}
+
+void PhysicsWorld::findPairs(Real delta)
+{
+    pairs = FrameArray<BodyPair>(frame_arena);
+
+    FrameArray<BroadphaseBounds> bounds(frame_arena);
+    FrameArray<BodyID> finite(frame_arena);
+    bounds.reserve(bodies.size());
+    finite.reserve(bodies.size());
+
+    Real extent_sum = 0.0;
+    uint32_t dynamic_count = 0;
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        const PhysicsBody& body = bodies[i];
+
+        // Same motion the speculative test tries, only the dynamic bodies' linear velocity
+        Real margin = (speculative_contacts && body.layer == PhysicsLayer::DYNAMIC) ? getLinearFromSpatial(body.velocity).norm() * delta : 0.0;
+        BroadphaseBounds box = GetWorldBounds(body.shape, body.transform, margin);
+        bounds.push_back(box);
+
+        if (!box.min.allFinite() || !box.max.allFinite()) continue;
+        finite.push_back(static_cast<BodyID>(i));
+
+        if (body.layer != PhysicsLayer::DYNAMIC) continue;
+        extent_sum += (box.max - box.min).maxCoeff();
+        dynamic_count++;
+    }
+
+    // Every pair needs a dynamic body
+    if (dynamic_count == 0) return;
+
+    // Twice the average dynamic body keeps most bodies in one to eight cells
+    Real cell_size = std::max(2.0 * extent_sum / dynamic_count, 1e-3);
+    Real inverse_cell_size = 1.0 / cell_size;
+
+    FrameArray<CellEntry> cells(frame_arena);
+    FrameArray<BodyID> gridded(frame_arena);
+    FrameArray<BodyID> large(frame_arena);
+    cells.reserve(finite.size());
+    for (BodyID id : finite)
+    {
+        const BroadphaseBounds& box = bounds[id];
+        int64_t min_x = GetCell(box.min[0], inverse_cell_size), max_x = GetCell(box.max[0], inverse_cell_size);
+        int64_t min_y = GetCell(box.min[1], inverse_cell_size), max_y = GetCell(box.max[1], inverse_cell_size);
+        int64_t min_z = GetCell(box.min[2], inverse_cell_size), max_z = GetCell(box.max[2], inverse_cell_size);
+
+        uint64_t cell_count = static_cast<uint64_t>(max_x - min_x + 1) * static_cast<uint64_t>(max_y - min_y + 1) * static_cast<uint64_t>(max_z - min_z + 1);
+        if (cell_count > MAX_BODY_CELLS)
+        {
+            large.push_back(id);
+            continue;
+        }
+        gridded.push_back(id);
+
+        for (int64_t x = min_x; x <= max_x; x++)
+            for (int64_t y = min_y; y <= max_y; y++)
+                for (int64_t z = min_z; z <= max_z; z++)
+                    cells.push_back(CellEntry{ .cell = GetCellKey(x, y, z), .id = id });
+    }
+
+    std::sort(cells.begin(), cells.end(), [](const CellEntry& a, const CellEntry& b) { return a.cell != b.cell ? a.cell < b.cell : a.id < b.id; });
+
+    auto add_pair = [&](BodyID a, BodyID b)
+    {
+        // Static and kinematic bodies can't be pushed, so there's nothing to solve between two of them
+        if (bodies[a].layer != PhysicsLayer::DYNAMIC && bodies[b].layer != PhysicsLayer::DYNAMIC) return;
+        if (!IsOverlapping(bounds[a], bounds[b])) return;
+        if (!joint_pairs.empty() && isJointed(a, b)) return;
+
+        pairs.push_back(a < b ? BodyPair{ .a = a, .b = b } : BodyPair{ .a = b, .b = a });
+    };
+
+    for (uint32_t start = 0; start < cells.size();)
+    {
+        uint32_t end = start + 1;
+        while (end < cells.size() && cells[end].cell == cells[start].cell) end++;
+
+        for (uint32_t i = start; i < end; i++)
+        {
+            for (uint32_t j = i + 1; j < end; j++)
+            {
+                // Only the cell holding the overlap's min corner owns the pair
+                Vector3 corner = bounds[cells[i].id].min.cwiseMax(bounds[cells[j].id].min);
+                uint64_t owner = GetCellKey(GetCell(corner[0], inverse_cell_size), GetCell(corner[1], inverse_cell_size), GetCell(corner[2], inverse_cell_size));
+                if (owner != cells[start].cell) continue;
+
+                add_pair(cells[i].id, cells[j].id);
+            }
+        }
+        start = end;
+    }
+
+    // The large bodies go against everything in the grid and then each other
+    for (uint32_t i = 0; i < large.size(); i++)
+    {
+        for (BodyID id : gridded)
+        {
+            add_pair(large[i], id);
+        }
+
+        for (uint32_t j = i + 1; j < large.size(); j++)
+        {
+            add_pair(large[i], large[j]);
+        }
+    }
+
+    // The grid order follows where the bodies are, so it changes as they move around. Deterministic mode wants the same order regardless
+    if (!deterministic) return;
+    std::sort(pairs.begin(), pairs.end(), [](const BodyPair& a, const BodyPair& b) { return a.a != b.a ? a.a < b.a : a.b < b.b; });
+}
@@ -6,10 +6,16 @@
 
 #include "physics.h"
 #include "dynamics.h"
+#include "triangle_mesh.h"
+#include "heightfield.h"
+#include "trace.h"
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 bool PhysicsWorld::isColliding(BodyID a, BodyID b)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::isColliding");
     if (a == b) return false;
 
     if (a > bodies.size() - 1 || b > bodies.size() - 1) return false;
@@ -19,15 +25,19 @@ bool PhysicsWorld::isColliding(BodyID a, BodyID b)
 }
 
 CollisionQuery PhysicsWorld::checkCollision(const PhysicsBody* a, const PhysicsBody* b)
+{
+    return checkCollision(&a->shape, &a->transform, &b->shape, &b->transform);
+}
+
+CollisionQuery PhysicsWorld::checkCollision(const PhysicsShape* a, const Transform* a_transform, const PhysicsShape* b, const Transform* b_transform)
 {
 
     bool swapped = false;
     // Sort by shape type
-    if (a->shape.type > b->shape.type)
+    if (a->type > b->type)
     {
-        const PhysicsBody* temp = a;
-        a = b;
-        b = temp;
+        std::swap(a, b);
+        std::swap(a_transform, b_transform);
         swapped = true;
     }
 
@@ -35,7 +45,10 @@ CollisionQuery PhysicsWorld::checkCollision(const PhysicsBody* a, const PhysicsB
     // (this assumes that the normal will always point from the first shape to the second shape which is probably what we want)
 
     // Call correct function depending on a and b's types
-    CollisionQuery result = collision_funcs[a->shape.type][b->shape.type](&a->shape, &a->transform, &b->shape, &b->transform); 
+    CollisionFunc func = collision_funcs[a->type][b->type];
+    if (func == nullptr) return CollisionQuery { .colliding = false };
+
+    CollisionQuery result = func(a, a_transform, b, b_transform);
     if (swapped)
     {
         result.norm = -result.norm;
@@ -44,62 +57,239 @@ CollisionQuery PhysicsWorld::checkCollision(const PhysicsBody* a, const PhysicsB
     return result;
 }
 
-void PhysicsWorld::handleCollisionVelocities(Collision& collision, Real delta)
+// 1 / (J M^-1 J^T) for an impulse along direction at the contact point
+static Real GetEffectiveMass(const Collision& collision, const SolverBody& a, const SolverBody& b, const Vector3& direction)
 {
-    PhysicsBody& a = bodies[collision.a];
-    PhysicsBody& b = bodies[collision.b];
-    
-    Real inverse_a_mass = (a.layer == PhysicsLayer::DYNAMIC) ? 1.0 / a.mass : 0.0;
-    Real inverse_b_mass = (b.layer == PhysicsLayer::DYNAMIC) ? 1.0 / b.mass : 0.0;
+    Vector3 radius_a_cross_d = collision.radius_a.cross(direction);
+    Vector3 radius_b_cross_d = collision.radius_b.cross(direction);
+    Real denominator = a.inverse_mass + b.inverse_mass + radius_a_cross_d.dot(a.inverse_inertia * radius_a_cross_d) + radius_b_cross_d.dot(b.inverse_inertia * radius_b_cross_d);
+    return denominator > 0.0 ? 1.0 / denominator : 0.0;
+}
+
+// Same for an angular impulse about direction
+static Real GetAngularEffectiveMass(const SolverBody& a, const SolverBody& b, const Vector3& direction)
+{
+    Real denominator = direction.dot(a.inverse_inertia * direction) + direction.dot(b.inverse_inertia * direction);
+    return denominator > 0.0 ? 1.0 / denominator : 0.0;
+}
+
+static Vector3 GetRelativeVelocity(const Collision& collision, const SolverBody& a, const SolverBody& b)
+{
+    return b.getPointVelocity(collision.radius_b) - a.getPointVelocity(collision.radius_a);
+}
+
+// Subtract from a and add to b because norm points from a to b
+static void ApplyImpulse(const Collision& collision, SolverBody& a, SolverBody& b, const Vector3& impulse)
+{
+    a.applyImpulse(-impulse, collision.radius_a);
+    b.applyImpulse(impulse, collision.radius_b);
+}
+
+static void ApplyAngularImpulse(SolverBody& a, SolverBody& b, const Vector3& impulse)
+{
+    a.applyAngularImpulse(-impulse);
+    b.applyAngularImpulse(impulse);
+}
+
+// Everything that doesn't change between iterations (lever arms, tangents, effective masses) is worked out here once per step
+// Restitution is based on the approach speed before any impulses are applied, so it's worked out here too
+void PhysicsWorld::prepareCollisionVelocities(Collision& collision)
+{
+    const PhysicsBody& a = bodies[collision.a];
+    const PhysicsBody& b = bodies[collision.b];
+    const SolverBody& a_solver = solver_bodies[collision.a];
+    const SolverBody& b_solver = solver_bodies[collision.b];
+
+    collision.radius_a = collision.point - a.transform.position;
+    collision.radius_b = collision.point - b.transform.position;
+    collision.local_point_a = a.transform.orientation.inverse() * collision.radius_a;
+    collision.local_point_b = b.transform.orientation.inverse() * collision.radius_b;
+
+    Vector3 relative_velocity = GetRelativeVelocity(collision, a_solver, b_solver);
+    Real velocity_along_normal = collision.norm.dot(relative_velocity);
+
+    Real restitution = (collision.depth >= 0.0 && velocity_along_normal < -1.0) ? std::min(a.material.restitution, b.material.restitution) : 0.0;
+    collision.bounce_velocity = -restitution * velocity_along_normal;
+    collision.normal_mass = GetEffectiveMass(collision, a_solver, b_solver, collision.norm);
+
+    // The first tangent follows an anisotropic body's friction axis if there is one, otherwise the sliding direction (so a sliding contact
+    // is stopped by one row and the box shaped friction limit doesn't bend its path). A contact that isn't sliding gets any perpendicular
+    Real friction = std::min(a.material.friction, b.material.friction);
+    collision.friction[0] = friction;
+    collision.friction[1] = friction;
+
+    const PhysicsBody* anisotropic = !a.material.friction_axis.isZero() ? &a : (!b.material.friction_axis.isZero() ? &b : nullptr);
+    Vector3 tangent = relative_velocity - collision.norm * velocity_along_normal;
+    if (anisotropic)
+    {
+        const PhysicsBody& other = (anisotropic == &a) ? b : a;
+        Vector3 axis = anisotropic->transform.orientation * anisotropic->material.friction_axis;
+        tangent = axis - collision.norm * collision.norm.dot(axis);
+        collision.friction[0] = std::min(anisotropic->material.axis_friction, other.material.friction);
+    }
+
+    Real tangent_length = tangent.norm();
+    if (tangent_length > 1e-6)
+    {
+        collision.tangents[0] = tangent / tangent_length;
+    }
+    else
+    {
+        // The axis is along the normal, so it doesn't pick a direction in the contact plane
+        collision.friction[0] = friction;
+        collision.tangents[0] = (std::abs(collision.norm[0]) < 0.57) ? collision.norm.cross(Vector3::UnitX()) : collision.norm.cross(Vector3::UnitY());
+        collision.tangents[0].normalize();
+    }
+    collision.tangents[1] = collision.norm.cross(collision.tangents[0]);
+
+    collision.rolling_friction = std::min(a.material.rolling_friction, b.material.rolling_friction);
+    for (int i = 0; i < 2; i++)
+    {
+        collision.tangent_masses[i] = GetEffectiveMass(collision, a_solver, b_solver, collision.tangents[i]);
+        collision.rolling_masses[i] = GetAngularEffectiveMass(a_solver, b_solver, collision.tangents[i]);
+    }
+}
+
+// One pass over a contact's rows: the normal drives the normal velocity to target_velocity (softened by soft), then friction and rolling friction
+// The normal goes first: contacts aren't warm started in the default solver, so this way friction has a normal impulse to work with from the first iteration
+// Returns the largest change in a row's velocity (impulse / effective mass)
+static Real SolveContactRows(Collision& collision, SolverBody& a, SolverBody& b, Real target_velocity, const SoftConstraint& soft)
+{
+    Real residual = 0.0;
+    {
+        // No early out when the bodies are separating, the accumulated impulse clamp has to be able to take back impulse from earlier iterations
+        Real velocity_along_normal = collision.norm.dot(GetRelativeVelocity(collision, a, b));
+        Real impulse = -(velocity_along_normal - target_velocity) * collision.normal_mass * soft.mass_scale - soft.impulse_scale * collision.accumulated_impulse;
+
+        Real new_impulse = std::max(impulse + collision.accumulated_impulse, 0.0);
+        Real delta_impulse = new_impulse - collision.accumulated_impulse;
+        collision.accumulated_impulse = new_impulse;
+
+        ApplyImpulse(collision, a, b, delta_impulse * collision.norm);
+        if (collision.normal_mass > 0.0) residual = std::abs(delta_impulse) / collision.normal_mass;
+    }
+
+    // Coulomb friction, each tangent is clamped to its coefficient times the normal impulse so far (a box shaped cone)
+    for (int i = 0; i < 2; i++)
+    {
+        Real max_impulse = collision.friction[i] * collision.accumulated_impulse;
+        Real impulse = -collision.tangents[i].dot(GetRelativeVelocity(collision, a, b)) * collision.tangent_masses[i];
+
+        Real new_impulse = std::clamp(collision.accumulated_friction[i] + impulse, -max_impulse, max_impulse);
+        Real delta_impulse = new_impulse - collision.accumulated_friction[i];
+        collision.accumulated_friction[i] = new_impulse;
+
+        ApplyImpulse(collision, a, b, delta_impulse * collision.tangents[i]);
+        if (collision.tangent_masses[i] > 0.0) residual = std::max(residual, std::abs(delta_impulse) / collision.tangent_masses[i]);
+    }
 
-    Matrix3 inverse_a_inertia = (a.layer == PhysicsLayer::DYNAMIC) ? a.inverse_inertia : Matrix3::Zero();
-    Matrix3 inverse_b_inertia = (b.layer == PhysicsLayer::DYNAMIC) ? b.inverse_inertia : Matrix3::Zero();
+    // Rolling friction, an angular impulse against the relative rotation about the tangents
+    if (collision.rolling_friction > 0.0)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            Real max_impulse = collision.rolling_friction * collision.accumulated_impulse;
+            Real impulse = -collision.tangents[i].dot(b.velocity.head<3>() - a.velocity.head<3>()) * collision.rolling_masses[i];
 
-    Vector3 radius_a = collision.point - a.transform.position;
-    Vector3 radius_b = collision.point - b.transform.position;
+            Real new_impulse = std::clamp(collision.accumulated_rolling[i] + impulse, -max_impulse, max_impulse);
+            Real delta_impulse = new_impulse - collision.accumulated_rolling[i];
+            collision.accumulated_rolling[i] = new_impulse;
 
-    Vector3 a_contact_point_linear_velocity = getLinearFromSpatial(a.velocity) + getAngularFromSpatial(a.velocity).cross(radius_a);
-    Vector3 b_contact_point_linear_velocity = getLinearFromSpatial(b.velocity) + getAngularFromSpatial(b.velocity).cross(radius_b);
+            ApplyAngularImpulse(a, b, delta_impulse * collision.tangents[i]);
+            if (collision.rolling_masses[i] > 0.0) residual = std::max(residual, std::abs(delta_impulse) / collision.rolling_masses[i]);
+        }
+    }
 
-    Vector3 relative_linear_velocity = b_contact_point_linear_velocity - a_contact_point_linear_velocity;
-    Real velocity_along_normal = collision.norm.dot(relative_linear_velocity);
+    return residual;
+}
 
-    // The two bodies are already moving apart so no need to change the velocity
-    if (velocity_along_normal > 0.0) return;
+Real PhysicsWorld::handleCollisionVelocities(Collision& collision, Real delta)
+{
+    SolverBody& a = solver_bodies[collision.a];
+    SolverBody& b = solver_bodies[collision.b];
+
+    // Speculative contacts (negative depth) are allowed to close the gap this step but no more
+    Real speculative_velocity = std::min(collision.depth, 0.0) / delta;
 
     Real baumgarte = 0.2;
     Real slop = 0.01;
 
     Real bias = baumgarte * std::max(collision.depth - slop, 0.0) / delta;
-    Real restitution = (velocity_along_normal < -1.0) ? std::min(a.material.restitution, b.material.restitution) : 0.0;
 
-    Real impulse = -(velocity_along_normal * (1.0 + restitution) + bias);
+    // Drive the normal velocity to the bounce / separation target
+    return SolveContactRows(collision, a, b, collision.bounce_velocity + bias + speculative_velocity, SoftConstraint{});
+}
+
+SoftConstraint SoftConstraint::Make(Real hertz, Real damping_ratio, Real h)
+{
+    if (hertz == 0.0) return SoftConstraint{};
+
+    Real omega = 2.0 * M_PI * hertz;
+    Real a1 = 2.0 * damping_ratio + h * omega;
+    Real a2 = h * omega * a1;
+    Real a3 = 1.0 / (1.0 + a2);
+    return SoftConstraint{ .bias_rate = omega / a1, .mass_scale = a2 * a3, .impulse_scale = a3 };
+}
+
+// Re-applies the impulses from the last sub-step
+void PhysicsWorld::warmStartCollision(const Collision& collision)
+{
+    SolverBody& a = solver_bodies[collision.a];
+    SolverBody& b = solver_bodies[collision.b];
+
+    ApplyImpulse(collision, a, b, collision.accumulated_impulse * collision.norm + collision.accumulated_friction[0] * collision.tangents[0] + collision.accumulated_friction[1] * collision.tangents[1]);
+    ApplyAngularImpulse(a, b, collision.accumulated_rolling[0] * collision.tangents[0] + collision.accumulated_rolling[1] * collision.tangents[1]);
+}
+
+// Sub-step version: the depth is worked out from where the contact points have moved to since the narrowphase, penetration is pushed out
+// by a soft spring (use_bias) or not at all (the relax pass), and restitution waits for applyRestitution at the end of the step
+void PhysicsWorld::handleSoftCollisionVelocities(Collision& collision, Real inverse_h, const SoftConstraint& soft, bool use_bias)
+{
+    const Transform& a_transform = bodies[collision.a].transform;
+    const Transform& b_transform = bodies[collision.b].transform;
+
+    // Both points started at collision.point, how far they've moved apart along the normal is how much shallower the contact is
+    Vector3 a_point = a_transform.position + a_transform.orientation * collision.local_point_a;
+    Vector3 b_point = b_transform.position + b_transform.orientation * collision.local_point_b;
+    Real depth = collision.depth - collision.norm.dot(b_point - a_point);
+
+    Real slop = 0.01;
+    Real target_velocity = 0.0;
+    SoftConstraint rigid;
+    const SoftConstraint* softness = &rigid;
+    if (depth < 0.0)
+    {
+        // Not touching (yet), close the gap this sub-step but no more
+        target_velocity = depth * inverse_h;
+    }
+    else if (use_bias)
+    {
+        target_velocity = std::min(soft.bias_rate * std::max(depth - slop, 0.0), substepMaxPushVelocity);
+        softness = &soft;
+    }
+
+    SolveContactRows(collision, solver_bodies[collision.a], solver_bodies[collision.b], target_velocity, *softness);
+}
+
+// One rigid pass on the normal for bouncy contacts, once the sub-steps have settled everything else
+void PhysicsWorld::applyRestitution(Collision& collision)
+{
+    if (collision.bounce_velocity <= 0.0 || collision.accumulated_impulse <= 0.0) return;
+
+    SolverBody& a = solver_bodies[collision.a];
+    SolverBody& b = solver_bodies[collision.b];
 
-    Vector3 radius_a_cross_n = radius_a.cross(collision.norm);
-    Vector3 radius_b_cross_n = radius_b.cross(collision.norm);
-    Real denominator = inverse_a_mass + inverse_b_mass + radius_a_cross_n.dot(inverse_a_inertia * radius_a_cross_n) + radius_b_cross_n.dot(inverse_b_inertia * radius_b_cross_n);
-    
-    impulse /= denominator;
+    Real velocity_along_normal = collision.norm.dot(GetRelativeVelocity(collision, a, b));
+    Real impulse = -(velocity_along_normal - collision.bounce_velocity) * collision.normal_mass;
 
     Real new_impulse = std::max(impulse + collision.accumulated_impulse, 0.0);
     Real delta_impulse = new_impulse - collision.accumulated_impulse;
     collision.accumulated_impulse = new_impulse;
 
-    Vector3 impulse_vec = delta_impulse * collision.norm;
-
-    // Subtract from a and add to b because norm points from a to b
-    Vector3 new_linear_a = getLinearFromSpatial(a.velocity) - inverse_a_mass * impulse_vec;
-    Vector3 new_angular_a = getAngularFromSpatial(a.velocity) - inverse_a_inertia * radius_a.cross(impulse_vec);
-    setLinearVelocity(collision.a, new_linear_a);
-    setAngularVelocity(collision.a, new_angular_a);
-
-    Vector3 new_linear_b = getLinearFromSpatial(b.velocity) + inverse_b_mass * impulse_vec;
-    Vector3 new_angular_b = getAngularFromSpatial(b.velocity) + inverse_b_inertia * radius_b.cross(impulse_vec);
-    setLinearVelocity(collision.b, new_linear_b);
-    setAngularVelocity(collision.b, new_angular_b);
+    ApplyImpulse(collision, a, b, delta_impulse * collision.norm);
 }
 
-void PhysicsWorld::handleCollisionPositions(const Collision& collision)
+Real PhysicsWorld::handleCollisionPositions(const Collision& collision)
 {
     PhysicsBody& a = bodies[collision.a];
     PhysicsBody& b = bodies[collision.b];
@@ -108,24 +298,30 @@ void PhysicsWorld::handleCollisionPositions(const Collision& collision)
     Real inverse_b_mass = (b.layer == PhysicsLayer::DYNAMIC) ? 1.0 / b.mass : 0.0;
     Real total_inverse_mass = inverse_a_mass + inverse_b_mass;
 
-    if (total_inverse_mass == 0.0) return;
+    if (total_inverse_mass == 0.0) return 0.0;
+
+    // Take off whatever earlier iterations (from any contact on these bodies) already corrected, otherwise every iteration pushes by the full depth again
+    Real current_depth = collision.depth - collision.norm.dot(b.position_correction - a.position_correction);
 
     Real slop = 0.01;
     Real percent = 0.2;
-    Real corrected_depth = std::max(collision.depth - slop, 0.0);
+    Real corrected_depth = std::max(current_depth - slop, 0.0);
     Vector3 norm_depth = collision.norm * (percent * corrected_depth / total_inverse_mass);
 
     if (inverse_a_mass > 0.0)
     {
         a.transform.position -= norm_depth * inverse_a_mass;
+        a.position_correction -= norm_depth * inverse_a_mass;
     }
 
     if (inverse_b_mass > 0.0)
     {
         b.transform.position += norm_depth * inverse_b_mass;
+        b.position_correction += norm_depth * inverse_b_mass;
     }
 
     // TODO: Add angular components as well
+    return corrected_depth;
 }
 
 CollisionQuery PhysicsWorld::checkSphereSphereCollision(const PhysicsShape* const a, const Transform* const at, const PhysicsShape* const b, const Transform* const bt)
@@ -149,28 +345,47 @@ CollisionQuery PhysicsWorld::checkSphereSphereCollision(const PhysicsShape* cons
     return CollisionQuery { .colliding = false };
 }
 
+// Planes are finite rectangles in their local xz plane (extent is the full width and depth) with the normal along local y
 CollisionQuery PhysicsWorld::checkSpherePlaneCollision(const PhysicsShape* const sphere, const Transform* const sphere_transform, const PhysicsShape* const plane, const Transform* const plane_transform)
 {
     Vector3 plane_norm = plane_transform->orientation * Vector3(0.0, 1.0, 0.0);
     plane_norm.normalize();
 
-    // Check collision using mathematical formula (don't need to divide by plane_norm.norm() because plane_norm is already normalized)
-    Real norm_projection = plane_norm.dot((sphere_transform->position - plane_transform->position));
+    // Sphere center in the plane's space
+    Vector3 local_center = plane_transform->orientation.inverse() * (sphere_transform->position - plane_transform->position);
+    Real radius = sphere->sphere.radius;
+
+    // Cheap reject using the distance to the infinite plane first
+    Real norm_projection = local_center[1];
     Real distance = std::abs(norm_projection);
+    if (distance > radius) return CollisionQuery { .colliding = false };
 
-    if (distance <= sphere->sphere.radius)
+    Vector2 half_extent = plane->plane.extent * 0.5;
+    Vector3 local_closest = Vector3(std::clamp(local_center[0], -half_extent[0], half_extent[0]), 0.0, std::clamp(local_center[2], -half_extent[1], half_extent[1]));
+    Vector3 point_on_plane = plane_transform->orientation * local_closest + plane_transform->position;
+
+    Vector3 diff = point_on_plane - sphere_transform->position;
+    Real closest_distance = diff.norm();
+    if (closest_distance > radius) return CollisionQuery { .colliding = false };
+
+    // Over the face the normal is the plane normal, past the edges it points at the closest point on the edge
+    Vector3 norm;
+    if (local_closest[0] == local_center[0] && local_closest[2] == local_center[2])
     {
-        Vector3 point_on_sphere = sphere_transform->position - plane_norm * sphere->sphere.radius;
-        Vector3 point_on_plane = sphere_transform->position - plane_norm * distance;
-        return CollisionQuery {
-            .colliding = true,
-            .norm = (norm_projection > 0.0) ? -plane_norm : plane_norm,
-            .depth = sphere->sphere.radius - distance,
-            .point = (point_on_sphere + point_on_plane) * 0.5
-        };
-    } 
+        norm = (norm_projection > 0.0) ? -plane_norm : plane_norm;
+    }
+    else
+    {
+        norm = diff / closest_distance;
+    }
 
-    return CollisionQuery { .colliding = false };
+    Vector3 point_on_sphere = sphere_transform->position + norm * radius;
+    return CollisionQuery {
+        .colliding = true,
+        .norm = norm,
+        .depth = radius - closest_distance,
+        .point = (point_on_sphere + point_on_plane) * 0.5
+    };
 }
 
 CollisionQuery PhysicsWorld::checkPlanePlaneCollision(const PhysicsShape* const a, const Transform* const a_transform, const PhysicsShape* const b, const Transform* const b_transform)
@@ -201,15 +416,15 @@ CollisionQuery PhysicsWorld::checkSphereOBBCollision(const PhysicsShape* const s
 
     if (distance <= sphere->sphere.radius)
     {
-        Vector3 norm = -(obb_transform->orientation * intersection_diff);
+        Vector3 norm = -(obb_transform->orientation * intersection_diff).normalized();
 
-        Vector3 point_on_box = obb_transform->orientation * intersection_point;
+        Vector3 point_on_box = obb_transform->orientation * intersection_point + obb_transform->position;
         Vector3 point_on_sphere = sphere_transform->position + norm * sphere->sphere.radius;
 
         return CollisionQuery{
             .colliding = true,
-            .norm = norm.normalized(),
-            .depth = distance,
+            .norm = norm,
+            .depth = sphere->sphere.radius - distance,
             .point = (point_on_box + point_on_sphere) * 0.5
         };
     }
@@ -229,135 +444,691 @@ CollisionQuery PhysicsWorld::checkPlaneOBBCollision(const PhysicsShape* const pl
                           + half_extent[1] * std::abs(plane_norm.dot(rotation_axes.col(1)))
                           + half_extent[2] * std::abs(plane_norm.dot(rotation_axes.col(2)));
 
-    Real signed_distance = std::abs(plane_norm.dot(obb_transform->position - plane_transform->position));
+    Real signed_distance = plane_norm.dot(obb_transform->position - plane_transform->position);
     Real distance = std::abs(signed_distance);
 
-    if (distance <= projected_radius)
+    if (distance > projected_radius) return CollisionQuery{ .colliding = false };
+
+    // Push the box back out of whichever side its center is on
+    Real side = (signed_distance >= 0.0) ? 1.0 : -1.0;
+    Vector3 norm = plane_norm * side;
+
+    Quaternion plane_inverse = plane_transform->orientation.inverse();
+    Vector2 plane_half_extent = plane->plane.extent * 0.5;
+
+    // Candidate contacts are the box vertices behind the plane that are within the plane's extents
+    // (vertices just in front of it count as well, as speculative contacts, so a box landing flat doesn't get a manifold along one edge)
+    Real manifold_tolerance = 0.01;
+    ContactPoint candidates[12];
+    uint32_t candidate_count = 0;
+    for (int i = 0; i < 8; i++)
     {
-        return CollisionQuery{
-            .colliding = true,
-            .norm = (signed_distance > 0.0) ? plane_norm : -plane_norm,
-            .depth = projected_radius - distance,
-            .point = Vector3::Zero()    // TODO
-        };
+        Vector3 corner = Vector3((i & 1) ? half_extent[0] : -half_extent[0],
+                                 (i & 2) ? half_extent[1] : -half_extent[1],
+                                 (i & 4) ? half_extent[2] : -half_extent[2]);
+        Vector3 vertex = rotation_axes * corner + obb_transform->position;
+        Vector3 local_vertex = plane_inverse * (vertex - plane_transform->position);
+
+        Real depth = -local_vertex[1] * side;
+        if (depth < -manifold_tolerance) continue;
+        if (std::abs(local_vertex[0]) > plane_half_extent[0] || std::abs(local_vertex[2]) > plane_half_extent[1]) continue;
+
+        candidates[candidate_count++] = ContactPoint{ .point = vertex + norm * (depth * 0.5), .depth = depth };
     }
 
-    return CollisionQuery{ .colliding = false };
+    // A box bigger than the plane (or hanging over its edge) also touches at the plane corners that are inside it
+    Matrix3 rotation_inverse = rotation_axes.transpose();
+    for (int i = 0; i < 4; i++)
+    {
+        Vector3 local_corner = Vector3((i & 1) ? plane_half_extent[0] : -plane_half_extent[0], 0.0, (i & 2) ? plane_half_extent[1] : -plane_half_extent[1]);
+        Vector3 corner = plane_transform->orientation * local_corner + plane_transform->position;
+        Vector3 box_corner = rotation_inverse * (corner - obb_transform->position);
+        if ((box_corner.cwiseAbs().array() > half_extent.array()).any()) continue;
+
+        Real depth = projected_radius - distance;
+        candidates[candidate_count++] = ContactPoint{ .point = corner - norm * (depth * 0.5), .depth = depth };
+    }
+
+    if (candidate_count == 0) return CollisionQuery{ .colliding = false };
+
+    // Keep the deepest points
+    uint32_t contact_count = std::min(candidate_count, MAX_CONTACT_POINTS);
+    std::partial_sort(candidates, candidates + contact_count, candidates + candidate_count, [](const ContactPoint& a, const ContactPoint& b) { return a.depth > b.depth; });
+
+    CollisionQuery result = {
+        .colliding = true,
+        .norm = norm,
+        .depth = candidates[0].depth,
+        .point = candidates[0].point,
+        .contact_count = contact_count
+    };
+    std::copy(candidates, candidates + contact_count, result.contacts);
+
+    return result;
 }
 
 
+// Clips a convex polygon against the plane dot(axis, p) <= limit (Sutherland-Hodgman), out has room for one more point than in
+static uint32_t ClipPolygon(const Vector3* in, uint32_t count, const Vector3& axis, Real limit, Vector3* out)
+{
+    uint32_t out_count = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const Vector3& start = in[i];
+        const Vector3& end = in[(i + 1) % count];
+        Real start_distance = axis.dot(start) - limit;
+        Real end_distance = axis.dot(end) - limit;
+
+        if (start_distance <= 0.0) out[out_count++] = start;
+        if ((start_distance <= 0.0) != (end_distance <= 0.0))
+        {
+            out[out_count++] = start + (end - start) * (start_distance / (start_distance - end_distance));
+        }
+    }
+    return out_count;
+}
+
+// Separating axis test over the 15 axes (Ericson 4.4.1), the one with the least overlap is the contact normal (a to b)
+// A face axis gets a manifold by clipping the other box's most anti-parallel face against the sides of the reference face, an edge axis
+// gets the one point between the closest points of the two edges
 CollisionQuery PhysicsWorld::checkOBBOBBCollision(const PhysicsShape* const a, const Transform* const a_transform, const PhysicsShape* const b, const Transform* const b_transform)
 {
-    const OBBShape* a_shape = &a->obb;
-    const OBBShape* b_shape = &b->obb;
-    
-    const float EPSILON = 1e-6f;
+    const Vector3& a_half = a->obb.half_extent;
+    const Vector3& b_half = b->obb.half_extent;
 
     Matrix3 a_axis = a_transform->orientation.toRotationMatrix();
     Matrix3 b_axis = b_transform->orientation.toRotationMatrix();
+    Vector3 offset = b_transform->position - a_transform->position;
 
-    Matrix3 rotation;
+    // Rotation of b in a's space, the epsilon keeps the edge axes from near parallel edges from giving false separations
+    const Real EPSILON = 1e-6;
+    Matrix3 rotation = a_axis.transpose() * b_axis;
     Matrix3 abs_rotation;
-
-    // Compute rotation which represents the rotation of b in terms of a's coordinate space
     for (int i = 0; i < 3; i++)
     {
         for (int j = 0; j < 3; j++)
         {
-            rotation(i, j) = a_axis.col(i).dot(b_axis.col(j));
             abs_rotation(i, j) = std::abs(rotation(i, j)) + EPSILON;
         }
     }
+    Vector3 translation = a_axis.transpose() * offset;
 
-    // Get the translation of b from a's center and put it in terms of a's coordinate system
-    Vector3 translation = b_transform->position - a_transform->position;
-    translation = Vector3(a_axis.col(0).dot(translation), a_axis.col(1).dot(translation), a_axis.col(2).dot(translation));
+    // Face axes of a, then b. b's faces (and then the edges) have to be a bit better to win so a resting contact doesn't flip between the two
+    Real best_overlap = std::numeric_limits<Real>::max();
+    Vector3 norm = Vector3::Zero();
+    int face = -1;  // 0-2 a's faces, 3-5 b's faces, -1 an edge pair
+    for (int i = 0; i < 3; i++)
+    {
+        Real rb = b_half.dot(abs_rotation.row(i));
+        Real overlap = a_half[i] + rb - std::abs(translation[i]);
+        if (overlap < 0.0) return CollisionQuery{ .colliding = false };
+        if (overlap < best_overlap)
+        {
+            best_overlap = overlap;
+            norm = a_axis.col(i) * (translation[i] >= 0.0 ? 1.0 : -1.0);
+            face = i;
+        }
+    }
 
-    float ra, rb;
+    const Real relative_tolerance = 0.95;
+    const Real absolute_tolerance = 0.001;
+    for (int i = 0; i < 3; i++)
+    {
+        Real ra = a_half.dot(abs_rotation.col(i));
+        Real distance = translation.dot(rotation.col(i));
+        Real overlap = ra + b_half[i] - std::abs(distance);
+        if (overlap < 0.0) return CollisionQuery{ .colliding = false };
+        if (overlap < best_overlap * relative_tolerance - absolute_tolerance)
+        {
+            best_overlap = overlap;
+            norm = b_axis.col(i) * (distance >= 0.0 ? 1.0 : -1.0);
+            face = 3 + i;
+        }
+    }
 
-    // Test axes of a
+    int edge_a = -1;
+    int edge_b = -1;
     for (int i = 0; i < 3; i++)
     {
-        ra = a_shape->half_extent(i);
-        rb = b_shape->half_extent.x() * abs_rotation(i, 0) + b_shape->half_extent.y() * abs_rotation(i, 1) + b_shape->half_extent.z() * abs_rotation(i, 2);
-        if (std::abs(translation(i)) > ra + rb) return CollisionQuery {
-            .colliding = false
+        for (int j = 0; j < 3; j++)
+        {
+            Vector3 axis = a_axis.col(i).cross(b_axis.col(j));
+            Real length = axis.norm();
+            if (length < 1e-6) continue;  // Parallel edges, the face axes already cover it
+            axis /= length;
+
+            Real ra = a_half[0] * std::abs(axis.dot(a_axis.col(0))) + a_half[1] * std::abs(axis.dot(a_axis.col(1))) + a_half[2] * std::abs(axis.dot(a_axis.col(2)));
+            Real rb = b_half[0] * std::abs(axis.dot(b_axis.col(0))) + b_half[1] * std::abs(axis.dot(b_axis.col(1))) + b_half[2] * std::abs(axis.dot(b_axis.col(2)));
+            Real distance = axis.dot(offset);
+            Real overlap = ra + rb - std::abs(distance);
+            if (overlap < 0.0) return CollisionQuery{ .colliding = false };
+            if (overlap < best_overlap * relative_tolerance - absolute_tolerance)
+            {
+                best_overlap = overlap;
+                norm = axis * (distance >= 0.0 ? 1.0 : -1.0);
+                face = -1;
+                edge_a = i;
+                edge_b = j;
+            }
+        }
+    }
+
+    if (face < 0)
+    {
+        // The edge of a furthest along the normal and the edge of b furthest against it, then the closest points between them (Ericson 5.1.9)
+        Vector3 a_point = a_transform->position;
+        Vector3 b_point = b_transform->position;
+        for (int k = 0; k < 3; k++)
+        {
+            if (k != edge_a) a_point += a_axis.col(k) * (a_axis.col(k).dot(norm) >= 0.0 ? a_half[k] : -a_half[k]);
+            if (k != edge_b) b_point += b_axis.col(k) * (b_axis.col(k).dot(norm) >= 0.0 ? -b_half[k] : b_half[k]);
+        }
+
+        Vector3 a_direction = a_axis.col(edge_a);
+        Vector3 b_direction = b_axis.col(edge_b);
+        Vector3 r = a_point - b_point;
+        Real along = a_direction.dot(b_direction);
+        Real c = a_direction.dot(r);
+        Real f = b_direction.dot(r);
+        Real s = std::clamp((along * f - c) / (1.0 - along * along), -a_half[edge_a], a_half[edge_a]);
+        Real t = std::clamp(along * s + f, -b_half[edge_b], b_half[edge_b]);
+        s = std::clamp(along * t - c, -a_half[edge_a], a_half[edge_a]);
+
+        return CollisionQuery{
+            .colliding = true,
+            .norm = norm,
+            .depth = best_overlap,
+            .point = ((a_point + a_direction * s) + (b_point + b_direction * t)) * 0.5
         };
     }
 
+    // The reference face is on whichever box gave the axis, its outward normal faces the other box
+    bool a_reference = face < 3;
+    int reference_face = face % 3;
+    const Matrix3& reference_axis = a_reference ? a_axis : b_axis;
+    const Matrix3& incident_axis = a_reference ? b_axis : a_axis;
+    const Vector3& reference_half = a_reference ? a_half : b_half;
+    const Vector3& incident_half = a_reference ? b_half : a_half;
+    Vector3 reference_position = a_reference ? a_transform->position : b_transform->position;
+    Vector3 incident_position = a_reference ? b_transform->position : a_transform->position;
+    Vector3 reference_norm = a_reference ? norm : Vector3(-norm);
+
+    // Incident face: the face of the other box pointing most against the reference normal
+    int incident_face = 0;
+    for (int k = 1; k < 3; k++)
+    {
+        if (std::abs(incident_axis.col(k).dot(reference_norm)) > std::abs(incident_axis.col(incident_face).dot(reference_norm))) incident_face = k;
+    }
+    Real incident_side = (incident_axis.col(incident_face).dot(reference_norm) > 0.0) ? -1.0 : 1.0;
+    Vector3 incident_center = incident_position + incident_axis.col(incident_face) * (incident_half[incident_face] * incident_side);
+    Vector3 u = incident_axis.col((incident_face + 1) % 3) * incident_half[(incident_face + 1) % 3];
+    Vector3 v = incident_axis.col((incident_face + 2) % 3) * incident_half[(incident_face + 2) % 3];
+
+    // Up to 8 points after clipping a quad by 4 planes
+    Vector3 polygon[8] = { incident_center + u + v, incident_center - u + v, incident_center - u - v, incident_center + u - v };
+    Vector3 clipped[8];
+    uint32_t count = 4;
+    for (int k = 1; k < 3 && count > 0; k++)
+    {
+        int side = (reference_face + k) % 3;
+        Vector3 side_axis = reference_axis.col(side);
+        Real center = side_axis.dot(reference_position);
+        count = ClipPolygon(polygon, count, side_axis, center + reference_half[side], clipped);
+        count = ClipPolygon(clipped, count, -side_axis, -center + reference_half[side], polygon);
+    }
 
-    // Test axes of b
-    for (int i = 0; i < 3; i++)
+    // Keep the clipped points behind the reference face (just in front of it counts too, same as a box on a plane)
+    Real manifold_tolerance = 0.01;
+    Real face_offset = reference_norm.dot(reference_position) + reference_half[reference_face];
+    ContactPoint candidates[8];
+    uint32_t candidate_count = 0;
+    for (uint32_t k = 0; k < count; k++)
     {
-        ra = a_shape->half_extent.x() * abs_rotation(0, i) + a_shape->half_extent.y() * abs_rotation(1, i) + a_shape->half_extent.z() * abs_rotation(2, i);
-        rb = b_shape->half_extent(i);
-        if ( std::abs(translation.x() * rotation(0, i) + translation.y() * rotation(1, i) + translation.z() * rotation(2, i)) > ra + rb) return CollisionQuery {
-            .colliding = false
-        };
+        Real depth = face_offset - reference_norm.dot(polygon[k]);
+        if (depth < -manifold_tolerance) continue;
+        candidates[candidate_count++] = ContactPoint{ .point = polygon[k] + reference_norm * (depth * 0.5), .depth = depth };
     }
 
+    if (candidate_count == 0)
+    {
+        // Only rounding can get here (the axis overlaps but the clipped face doesn't), fall back to the incident face's center
+        return CollisionQuery{ .colliding = true, .norm = norm, .depth = best_overlap, .point = incident_center + reference_norm * (best_overlap * 0.5) };
+    }
 
-    // Test cross axes
+    // Keep the deepest points
+    uint32_t contact_count = std::min(candidate_count, MAX_CONTACT_POINTS);
+    std::partial_sort(candidates, candidates + contact_count, candidates + candidate_count, [](const ContactPoint& a, const ContactPoint& b) { return a.depth > b.depth; });
 
-    ra = a_shape->half_extent.y() * abs_rotation(2, 0) + a_shape->half_extent.z() * abs_rotation(1, 0);
-    rb = b_shape->half_extent.y() * abs_rotation(0, 2) + b_shape->half_extent.z() * abs_rotation(0, 1);
-    if (std::abs(translation.z() * rotation(1, 0) - translation.y() * rotation(2, 0)) > ra + rb) return CollisionQuery {
-        .colliding = false
+    CollisionQuery result = {
+        .colliding = true,
+        .norm = norm,
+        .depth = candidates[0].depth,
+        .point = candidates[0].point,
+        .contact_count = contact_count
     };
+    std::copy(candidates, candidates + contact_count, result.contacts);
 
-    ra = a_shape->half_extent.y() * abs_rotation(2, 1) + a_shape->half_extent.z() * abs_rotation(1, 1);
-    rb = b_shape->half_extent.x() * abs_rotation(0, 2) + b_shape->half_extent.z() * abs_rotation(0, 0);
-    if (std::abs(translation.z() * rotation(1, 1) - translation.y() * rotation(2, 1)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+    return result;
+}
 
-    ra = a_shape->half_extent.y() * abs_rotation(2, 2) + a_shape->half_extent.z() * abs_rotation(1, 2);
-    rb = b_shape->half_extent.x() * abs_rotation(0, 1) + b_shape->half_extent.y() * abs_rotation(0, 0);
-    if (std::abs(translation.z() * rotation(1, 2) - translation.y() * rotation(2, 2)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+// From Real-Time Collision Detection (Ericson) 5.1.5
+static Vector3 closestPointOnTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    Vector3 ab = b - a;
+    Vector3 ac = c - a;
+    Vector3 ap = p - a;
+    Real d1 = ab.dot(ap);
+    Real d2 = ac.dot(ap);
+    if (d1 <= 0.0 && d2 <= 0.0) return a;
+
+    Vector3 bp = p - b;
+    Real d3 = ab.dot(bp);
+    Real d4 = ac.dot(bp);
+    if (d3 >= 0.0 && d4 <= d3) return b;
+
+    Real vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) return a + ab * (d1 / (d1 - d3));
+
+    Vector3 cp = p - c;
+    Real d5 = ab.dot(cp);
+    Real d6 = ac.dot(cp);
+    if (d6 >= 0.0 && d5 <= d6) return c;
+
+    Real vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) return a + ac * (d2 / (d2 - d6));
+
+    Real va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    Real denom = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
 
-    ra = a_shape->half_extent.x() * abs_rotation(2, 0) + a_shape->half_extent.z() * abs_rotation(0, 0);
-    rb = b_shape->half_extent.y() * abs_rotation(1, 2) + b_shape->half_extent.z() * abs_rotation(1, 1);
-    if (std::abs(translation.x() * rotation(2, 0) - translation.z() * rotation(0, 0)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+// One sided triangles (terrain) treat everything behind the face as solid, so a sphere whose center has sunk below the surface is still pushed out the front
+// That only holds while the center is over the triangle, otherwise (e.g. the far slope of a ridge) the neighbouring triangles own it and the plain distance test is used
+static bool sphereTriangleContact(const Vector3& center, Real radius, const Vector3* triangle, bool one_sided, Vector3& norm, Real& depth, Vector3& point)
+{
+    Vector3 closest = closestPointOnTriangle(center, triangle[0], triangle[1], triangle[2]);
+    Vector3 diff = closest - center;
+    Real distance = diff.norm();
+    Vector3 face_norm = (triangle[1] - triangle[0]).cross(triangle[2] - triangle[0]).normalized();
+    Real plane_distance = face_norm.dot(center - triangle[0]);
+
+    // The closest point is the center's projection exactly when it's as far away as the plane
+    bool over_face = distance + plane_distance <= 1e-9 * (1.0 + distance);
+    if (one_sided && plane_distance < 0.0 && over_face)
+    {
+        norm = -face_norm;
+        depth = radius + distance;
+    }
+    else
+    {
+        if (distance > radius) return false;
 
-    ra = a_shape->half_extent.x() * abs_rotation(2, 1) + a_shape->half_extent.z() * abs_rotation(0, 1);
-    rb = b_shape->half_extent.x() * abs_rotation(1, 2) + b_shape->half_extent.z() * abs_rotation(1, 0);
-    if (std::abs(translation.x() * rotation(2, 1) - translation.z() * rotation(0, 1)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+        // Center is on the triangle so fall back to the face normal (pointing into the triangle)
+        norm = (distance > 1e-9) ? Vector3(diff / distance) : Vector3(-face_norm);
+        depth = radius - distance;
+    }
 
-    ra = a_shape->half_extent.x() * abs_rotation(2, 2) + a_shape->half_extent.z() * abs_rotation(0, 2);
-    rb = b_shape->half_extent.x() * abs_rotation(1, 1) + b_shape->half_extent.y() * abs_rotation(1, 0);
-    if (std::abs(translation.x()* rotation(2, 2) - translation.z() * rotation(0, 2)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+    point = (center + norm * radius + closest) * 0.5;
+    return true;
+}
 
-    ra = a_shape->half_extent.x() * abs_rotation(1, 0) + a_shape->half_extent.y() * abs_rotation(0, 0);
-    rb = b_shape->half_extent.y() * abs_rotation(2, 2) + b_shape->half_extent.z() * abs_rotation(2, 1);
-    if (std::abs(translation.y() * rotation(0, 0) - translation.x() * rotation(1, 0)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+// Separating axis test of a box (centered at the origin, axis aligned) against a triangle in the box's space
+// On overlap returns the axis of least penetration pointing from the box towards the triangle
+static bool boxTriangleSAT(const Vector3& half_extent, const Vector3* triangle, bool one_sided, Vector3& norm, Real& depth)
+{
+    Vector3 edges[3] = { triangle[1] - triangle[0], triangle[2] - triangle[1], triangle[0] - triangle[2] };
 
-    ra = a_shape->half_extent.x() * abs_rotation(1, 1) + a_shape->half_extent.y() * abs_rotation(0, 1);
-    rb = b_shape->half_extent.x() * abs_rotation(2, 2) + b_shape->half_extent.z() * abs_rotation(2, 0);
-    if (std::abs(translation.y() * rotation(0, 1) - translation.x() * rotation(1, 1)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+    depth = std::numeric_limits<Real>::max();
 
-    ra = a_shape->half_extent.x() * abs_rotation(1, 2) + a_shape->half_extent.y() * abs_rotation(0, 2);
-    rb = b_shape->half_extent.x() * abs_rotation(2, 1) + b_shape->half_extent.y() * abs_rotation(2, 0);
-    if (std::abs(translation.y() * rotation(0, 2) - translation.x() * rotation(1, 2)) > ra + rb) return CollisionQuery {
-        .colliding = false
-    };
+    // Prefer the face normal unless another axis is clearly better, otherwise resting contacts flicker between axes
+    auto testAxis = [&](Vector3 axis, Real bias, bool face) -> bool {
+        Real length = axis.norm();
+        if (length < 1e-9) return true;
+        axis /= length;
 
-    // FIXME: FIND OUT HOW TO CALCULATE DEPTH AND NORM
-    return CollisionQuery {
-        .colliding = true,
-        .norm = Vector3::Identity(),    // TODO
-        .depth = 0.0,
-        .point = Vector3::Zero()        // TODO
+        Real p0 = axis.dot(triangle[0]);
+        Real p1 = axis.dot(triangle[1]);
+        Real p2 = axis.dot(triangle[2]);
+        Real triangle_min = std::min({p0, p1, p2});
+        Real triangle_max = std::max({p0, p1, p2});
+        Real box_radius = half_extent.dot(axis.cwiseAbs());
+
+        if (triangle_max < -box_radius) return false;
+        if (triangle_min > box_radius && !(one_sided && face)) return false;
+
+        // Push the box whichever way is shorter (one sided faces can only push the box out the front)
+        Real positive_depth = box_radius - triangle_min;
+        Real negative_depth = triangle_max + box_radius;
+        bool push_back = (one_sided && face) || negative_depth < positive_depth;
+        Real axis_depth = push_back ? negative_depth : positive_depth;
+
+        if (axis_depth * bias < depth)
+        {
+            depth = axis_depth;
+            norm = push_back ? Vector3(-axis) : axis;
+        }
+        return true;
     };
+
+    if (!testAxis(edges[0].cross(edges[1]), 1.0, true)) return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!testAxis(Vector3::Unit(i), 1.05, false)) return false;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            if (!testAxis(Vector3::Unit(i).cross(edges[j]), 1.05, false)) return false;
+        }
+    }
+
+    return true;
+}
+
+// Triangle soups (meshes and heightfields) only produce a single contact (the deepest triangle) since CollisionQuery only holds one point
+// query(min, max, func) has to call func(const Vector3* triangle) for the triangles near the given bounds in the soup's local space
+template <typename Query>
+static CollisionQuery checkSphereTriangles(const PhysicsShape* const sphere, const Transform* const sphere_transform, const Transform* const triangles_transform, bool one_sided, Query&& query)
+{
+    Real radius = sphere->sphere.radius;
+
+    // Do everything in the soup's local space so its acceleration structure never has to be transformed
+    Quaternion triangles_inverse = triangles_transform->orientation.inverse();
+    Vector3 center = triangles_inverse * (sphere_transform->position - triangles_transform->position);
+    Vector3 radius_vec = Vector3::Constant(radius);
+
+    CollisionQuery result = { .colliding = false };
+    query(center - radius_vec, center + radius_vec, [&](const Vector3* triangle) {
+        Vector3 norm, point;
+        Real depth;
+        if (!sphereTriangleContact(center, radius, triangle, one_sided, norm, depth, point) || depth <= result.depth) return;
+
+        result.colliding = true;
+        result.norm = norm;
+        result.depth = depth;
+        result.point = point;
+    });
+
+    if (result.colliding)
+    {
+        result.norm = triangles_transform->orientation * result.norm;
+        result.point = triangles_transform->orientation * result.point + triangles_transform->position;
+    }
+
+    return result;
+}
+
+template <typename Query>
+static CollisionQuery checkOBBTriangles(const PhysicsShape* const obb, const Transform* const obb_transform, const Transform* const triangles_transform, bool one_sided, Query&& query)
+{
+    Vector3 half_extent = obb->obb.half_extent;
+
+    // Box in the soup's space, used to find the bounds to query with
+    Quaternion triangles_inverse = triangles_transform->orientation.inverse();
+    Vector3 center = triangles_inverse * (obb_transform->position - triangles_transform->position);
+    Matrix3 rotation = (triangles_inverse * obb_transform->orientation).toRotationMatrix();
+    Vector3 box_extent = rotation.cwiseAbs() * half_extent;
+
+    Matrix3 rotation_inverse = rotation.transpose();
+
+    CollisionQuery result = { .colliding = false };
+    query(center - box_extent, center + box_extent, [&](const Vector3* triangle) {
+        // Triangle in box space
+        Vector3 local[3] = {
+            rotation_inverse * (triangle[0] - center),
+            rotation_inverse * (triangle[1] - center),
+            rotation_inverse * (triangle[2] - center)
+        };
+
+        Vector3 norm;
+        Real depth;
+        if (!boxTriangleSAT(half_extent, local, one_sided, norm, depth) || depth <= result.depth) return;
+
+        // Approximate the contact as the box vertex furthest along the normal, pulled back to the middle of the overlap
+        // (axes the normal is nearly perpendicular to use the middle of the box so face and edge contacts land in the middle of the feature)
+        Vector3 deepest_vertex;
+        for (int i = 0; i < 3; i++)
+        {
+            deepest_vertex[i] = (std::abs(norm[i]) < 1e-3) ? 0.0 : std::copysign(half_extent[i], norm[i]);
+        }
+
+        result.colliding = true;
+        result.norm = norm;
+        result.depth = depth;
+        result.point = deepest_vertex - norm * (depth * 0.5);
+    });
+
+    if (result.colliding)
+    {
+        result.norm = obb_transform->orientation * result.norm;
+        result.point = obb_transform->orientation * result.point + obb_transform->position;
+    }
+
+    return result;
+}
+
+CollisionQuery PhysicsWorld::checkSphereMeshCollision(const PhysicsShape* const sphere, const Transform* const sphere_transform, const PhysicsShape* const mesh, const Transform* const mesh_transform)
+{
+    const TriangleMesh* triangles = mesh->mesh.mesh;
+    return checkSphereTriangles(sphere, sphere_transform, mesh_transform, false, [&](const Vector3& min, const Vector3& max, auto&& func) {
+        triangles->queryTriangles(min, max, func);
+    });
+}
+
+CollisionQuery PhysicsWorld::checkOBBMeshCollision(const PhysicsShape* const obb, const Transform* const obb_transform, const PhysicsShape* const mesh, const Transform* const mesh_transform)
+{
+    const TriangleMesh* triangles = mesh->mesh.mesh;
+    return checkOBBTriangles(obb, obb_transform, mesh_transform, false, [&](const Vector3& min, const Vector3& max, auto&& func) {
+        triangles->queryTriangles(min, max, func);
+    });
+}
+
+CollisionQuery PhysicsWorld::checkSphereHeightFieldCollision(const PhysicsShape* const sphere, const Transform* const sphere_transform, const PhysicsShape* const heightfield, const Transform* const heightfield_transform)
+{
+    const HeightField* field = heightfield->heightfield.field;
+    return checkSphereTriangles(sphere, sphere_transform, heightfield_transform, true, [&](const Vector3& min, const Vector3& max, auto&& func) {
+        field->queryTriangles(min, max, func);
+    });
+}
+
+CollisionQuery PhysicsWorld::checkOBBHeightFieldCollision(const PhysicsShape* const obb, const Transform* const obb_transform, const PhysicsShape* const heightfield, const Transform* const heightfield_transform)
+{
+    const HeightField* field = heightfield->heightfield.field;
+    return checkOBBTriangles(obb, obb_transform, heightfield_transform, true, [&](const Vector3& min, const Vector3& max, auto&& func) {
+        field->queryTriangles(min, max, func);
+    });
+}
+
+// Radius of a sphere that always fits inside the shape, continuous collision sweeps this so rotation can be ignored
+static Real getCoreRadius(const PhysicsShape& shape)
+{
+    switch (shape.type)
+    {
+        case ShapeType::SPHERE:
+            return shape.sphere.radius;
+        case ShapeType::OBB:
+            return shape.obb.half_extent.minCoeff();
+        default:
+            return 0.0;
+    }
+}
+
+// Radius of a sphere around the body's position that holds the whole shape (infinite for shapes that do their own culling)
+static Real getBoundingRadius(const PhysicsShape& shape)
+{
+    switch (shape.type)
+    {
+        case ShapeType::SPHERE:
+            return shape.sphere.radius;
+        case ShapeType::PLANE:
+            return shape.plane.extent.norm() * 0.5;
+        case ShapeType::OBB:
+            return shape.obb.half_extent.norm();
+        default:
+            return std::numeric_limits<Real>::max();
+    }
+}
+
+// Distance from a point to the surface of a body (0 inside), anything past max_distance is returned as max_distance
+Real PhysicsWorld::getDistance(const Vector3& point, const PhysicsBody& body, Real max_distance)
+{
+    Vector3 local = body.transform.orientation.inverse() * (point - body.transform.position);
+    Vector3 search = Vector3::Constant(max_distance);
+    Real distance = max_distance;
+
+    switch (body.shape.type)
+    {
+        case ShapeType::SPHERE:
+            distance = std::max(local.norm() - body.shape.sphere.radius, 0.0);
+            break;
+        case ShapeType::PLANE:
+        {
+            Vector2 half_extent = body.shape.plane.extent * 0.5;
+            Vector3 closest = Vector3(std::clamp(local[0], -half_extent[0], half_extent[0]), 0.0, std::clamp(local[2], -half_extent[1], half_extent[1]));
+            distance = (local - closest).norm();
+            break;
+        }
+        case ShapeType::OBB:
+        {
+            Vector3 half_extent = body.shape.obb.half_extent;
+            distance = (local - local.cwiseMax(-half_extent).cwiseMin(half_extent)).norm();
+            break;
+        }
+        case ShapeType::MESH:
+            body.shape.mesh.mesh->queryTriangles(local - search, local + search, [&](const Vector3* triangle) {
+                distance = std::min(distance, (closestPointOnTriangle(local, triangle[0], triangle[1], triangle[2]) - local).norm());
+            });
+            break;
+        case ShapeType::HEIGHTFIELD:
+            body.shape.heightfield.field->queryTriangles(local - search, local + search, [&](const Vector3* triangle) {
+                distance = std::min(distance, (closestPointOnTriangle(local, triangle[0], triangle[1], triangle[2]) - local).norm());
+            });
+            break;
+        default:
+            break;
+    }
+
+    return std::min(distance, max_distance);
+}
+
+// Conservative advancement of the body's core sphere along its linear motion against every other body
+// Returns the fraction of the step it can move (1 if it doesn't hit anything)
+Real PhysicsWorld::computeTimeOfImpact(BodyID id, Real delta)
+{
+    const PhysicsBody& body = bodies[id];
+    Real core_radius = getCoreRadius(body.shape);
+    Vector3 velocity = body.transform.orientation * getLinearFromSpatial(body.velocity);
+
+    // Bodies moving less than half their core per step can't skip past anything the discrete checks would miss
+    if (core_radius <= 0.0 || velocity.norm() * delta < core_radius * 0.5) return 1.0;
+
+    // Aim to stop slightly inside the other shape so the discrete check finds the contact next step
+    Real penetration = 0.005;
+    Real tolerance = 1e-4;
+    Real target = core_radius - penetration;
+
+    Real toi = 1.0;
+    for (BodyID i = 0; i < bodies.size(); i++)
+    {
+        if (i == id) continue;
+
+        const PhysicsBody& other = bodies[i];
+        Vector3 other_velocity = (other.layer == PhysicsLayer::DYNAMIC) ? Vector3(other.transform.orientation * getLinearFromSpatial(other.velocity)) : Vector3::Zero();
+        Vector3 motion = (velocity - other_velocity) * delta;
+        Real length = motion.norm();
+        if (length < 1e-9) continue;
+
+        // Skip bodies the swept core can't reach
+        Vector3 to_other = other.transform.position - body.transform.position;
+        Real along = std::clamp(to_other.dot(motion) / (length * length), 0.0, 1.0);
+        if ((to_other - motion * along).norm() > getBoundingRadius(other.shape) + core_radius) continue;
+
+        Real reach = length + core_radius;
+        Real separation = getDistance(body.transform.position, other, reach) - target;
+
+        // Already touching, the discrete contact handles it
+        if (separation <= tolerance) continue;
+
+        Real t = 0.0;
+        for (uint32_t j = 0; j < continuousMaxIterations; j++)
+        {
+            t += separation / length;
+            if (t >= toi) break;
+
+            separation = getDistance(body.transform.position + motion * t, other, reach) - target;
+            if (separation <= tolerance || j == continuousMaxIterations - 1)
+            {
+                toi = t;
+                break;
+            }
+        }
+    }
+
+    return toi;
+}
+
+
+// Finds contacts for pairs that aren't touching yet but could this step. The returned depths are negative (the gap between the shapes)
+CollisionQuery PhysicsWorld::checkSpeculativeCollision(const PhysicsBody* a, const PhysicsBody* b, Real delta)
+{
+    Vector3 a_velocity = (a->layer == PhysicsLayer::DYNAMIC) ? Vector3(a->transform.orientation * getLinearFromSpatial(a->velocity)) : Vector3::Zero();
+    Vector3 b_velocity = (b->layer == PhysicsLayer::DYNAMIC) ? Vector3(b->transform.orientation * getLinearFromSpatial(b->velocity)) : Vector3::Zero();
+
+    // Move the faster body relative to the other one (so its contact points get the exact lever arms)
+    bool a_moves = a_velocity.squaredNorm() >= b_velocity.squaredNorm();
+    const PhysicsBody* mover = a_moves ? a : b;
+    const PhysicsBody* other = a_moves ? b : a;
+    Vector3 motion = (a_moves ? Vector3(a_velocity - b_velocity) : Vector3(b_velocity - a_velocity)) * delta;
+    Real length = motion.norm();
+
+    if (length < 1e-6) return CollisionQuery{ .colliding = false };
+
+    Real mover_bound = getBoundingRadius(mover->shape);
+    Real other_bound = getBoundingRadius(other->shape);
+    if (mover_bound < std::numeric_limits<Real>::max() && other_bound < std::numeric_limits<Real>::max())
+    {
+        Vector3 to_other = other->transform.position - mover->transform.position;
+        Real along = std::clamp(to_other.dot(motion) / (length * length), 0.0, 1.0);
+        if ((to_other - motion * along).norm() > mover_bound + other_bound) return CollisionQuery{ .colliding = false };
+    }
+
+    // Sample the motion in steps no longer than the mover's core so thin shapes aren't skipped over
+    Real core_radius = getCoreRadius(mover->shape);
+    uint32_t samples = (core_radius > 0.0) ? static_cast<uint32_t>(std::ceil(length / core_radius)) : 1;
+    samples = std::clamp(samples, 1u, speculativeMaxSamples);
+
+    for (uint32_t i = 1; i <= samples; i++)
+    {
+        Vector3 displacement = motion * (static_cast<Real>(i) / samples);
+        Transform moved = mover->transform;
+        moved.position += displacement;
+
+        CollisionQuery result = checkCollision(&mover->shape, &moved, &other->shape, &other->transform);
+        if (!result.colliding) continue;
+
+        // The gap now is how far the mover travelled along the normal minus how far it ended up overlapping
+        Real travelled = displacement.dot(result.norm);
+        result.depth = std::min(result.depth - travelled, 0.0);
+        result.point -= displacement;
+        for (uint32_t j = 0; j < result.contact_count; j++)
+        {
+            result.contacts[j].depth = std::min(result.contacts[j].depth - travelled, 0.0);
+            result.contacts[j].point -= displacement;
+        }
+
+        // Normal has to point from a to b
+        if (!a_moves)
+        {
+            result.norm = -result.norm;
+        }
+
+        return result;
+    }
+
+    return CollisionQuery{ .colliding = false };
 }
\ No newline at end of file
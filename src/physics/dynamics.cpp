@@ -1,22 +1,9 @@
 #include "dynamics.h"
+#include <cstring>
 
-// will eventually want to pass in a whole kinematic tree with joints but for now just focus on a single body
+// Single free body only, kinematic trees with joints go through KinematicTree (kinematic_tree.cpp)
 // Returns the necessary force for the given inputs
 
-static Vector6 forceCrossProduct(const Vector6& a, const Vector6& b)
-{
-
-    Vector6 product;
-    product << a[1] * b[2] - a[2] * b[1] + a[4] * b[5] - a[5] * b[4],
-               a[2] * b[0] - a[0] * b[2] + a[5] * b[3] - a[3] * b[5],
-               a[0] * b[1] - a[1] * b[0] + a[3] * b[4] - a[4] * b[3],
-               a[1] * b[5] - a[2] * b[4],
-               a[2] * b[3] - a[0] * b[5],
-               a[0] * b[4] - a[1] * b[3];
-
-    return product;
-}
-
 Vector6 calculateInverseDynamics(const RigidBodyState& rb, const Vector6& desiredAcceleration, const Vector6& externalAcceleration)
 {
 
@@ -53,16 +40,137 @@ Vector6 calculateInverseDynamics(const RigidBodyState& rb, const Vector6& desire
 
             // Project the force along the joint axis
     Vector6 iv = rb.spatial_inertia * rb.velocity;
-    Vector6 result = rb.spatial_inertia * (desiredAcceleration - externalAcceleration) + forceCrossProduct(rb.velocity, iv);
+    Vector6 result = rb.spatial_inertia * (desiredAcceleration - externalAcceleration) + ForceCross(rb.velocity, iv);
 
     // Won't actually return anything as everything will be stored in the rigid bodies
     return result;
 }
 
 
+// Instances per block. The inner loops run over this many lanes of local arrays, which the compiler turns into SIMD
+static constexpr uint32_t batch_width = 16;
+
+// Runs instances [start, start + count) (less than one block) through a zero padded copy so the block loop always runs full width
+static void CalculatePaddedInverseDynamics(const InverseDynamicsBatch& batch, uint32_t start, uint32_t count)
+{
+    // velocity, desired - external, mass, centre of mass, inertia, result and a row of zeros for the external acceleration
+    Real padded[6 + 6 + 1 + 3 + 6 + 6 + 1][batch_width] = {};
+    Real* zero = padded[28];
+    InverseDynamicsBatch full = { .count = batch_width };
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        std::memcpy(padded[k], batch.velocity[k] + start, count * sizeof(Real));
+        std::memcpy(padded[6 + k], batch.desired_acceleration[k] + start, count * sizeof(Real));
+        for (uint32_t i = 0; i < count; i++) padded[6 + k][i] -= batch.external_acceleration[k][start + i];
+
+        full.velocity[k] = padded[k];
+        full.desired_acceleration[k] = padded[6 + k];
+        full.external_acceleration[k] = zero;  // Desired already holds desired - external
+        full.result[k] = padded[22 + k];
+    }
+
+    std::memcpy(padded[12], batch.mass + start, count * sizeof(Real));
+    full.mass = padded[12];
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        std::memcpy(padded[13 + k], batch.center_of_mass[k] + start, count * sizeof(Real));
+        full.center_of_mass[k] = padded[13 + k];
+    }
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        std::memcpy(padded[16 + k], batch.inertia[k] + start, count * sizeof(Real));
+        full.inertia[k] = padded[16 + k];
+    }
+
+    calculateInverseDynamicsBatch(full);
+    for (uint32_t k = 0; k < 6; k++) std::memcpy(batch.result[k] + start, padded[22 + k], count * sizeof(Real));
+}
+
+void calculateInverseDynamicsBatch(const InverseDynamicsBatch& batch)
+{
+    // The leftover instances past the last full block go through the padded copy. An overlapping last block would read inputs the previous
+    // block had already overwritten when result points at one of them
+    uint32_t block_end = batch.count - batch.count % batch_width;
+    if (block_end < batch.count) CalculatePaddedInverseDynamics(batch, block_end, batch.count - block_end);
+
+    for (uint32_t start = 0; start < block_end; start += batch_width)
+    {
+        // Gather the block into locals so the maths below can't alias the outputs
+        Real velocity[6][batch_width];
+        Real acceleration[6][batch_width];
+        Real mass[batch_width];
+        Real center[3][batch_width];
+        Real inertia[6][batch_width];
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            for (uint32_t i = 0; i < batch_width; i++)
+            {
+                velocity[k][i] = batch.velocity[k][start + i];
+                acceleration[k][i] = batch.desired_acceleration[k][start + i] - batch.external_acceleration[k][start + i];
+                inertia[k][i] = batch.inertia[k][start + i];
+            }
+        }
+        for (uint32_t i = 0; i < batch_width; i++) mass[i] = batch.mass[start + i];
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            for (uint32_t i = 0; i < batch_width; i++) center[k][i] = batch.center_of_mass[k][start + i];
+        }
+
+        // I * a + v x* (I * v) with both products done the SpatialInertia::operator* way, written out per lane so the loop is one straight
+        // line the compiler vectorises
+        Real force[6][batch_width];
+        for (uint32_t i = 0; i < batch_width; i++)
+        {
+            const Real m = mass[i];
+            const Real cx = center[0][i], cy = center[1][i], cz = center[2][i];
+            const Real ixx = inertia[0][i], iyy = inertia[1][i], izz = inertia[2][i];
+            const Real ixy = inertia[3][i], ixz = inertia[4][i], iyz = inertia[5][i];
+
+            const Real w0 = velocity[0][i], w1 = velocity[1][i], w2 = velocity[2][i];
+            const Real v0 = velocity[3][i], v1 = velocity[4][i], v2 = velocity[5][i];
+            const Real a0 = acceleration[0][i], a1 = acceleration[1][i], a2 = acceleration[2][i];
+            const Real a3 = acceleration[3][i], a4 = acceleration[4][i], a5 = acceleration[5][i];
+
+            // I * v: linear momentum of the centre of mass, then the angular momentum about the origin
+            const Real f0 = m * (v0 + w1 * cz - w2 * cy);
+            const Real f1 = m * (v1 + w2 * cx - w0 * cz);
+            const Real f2 = m * (v2 + w0 * cy - w1 * cx);
+            const Real n0 = ixx * w0 + ixy * w1 + ixz * w2 + cy * f2 - cz * f1;
+            const Real n1 = ixy * w0 + iyy * w1 + iyz * w2 + cz * f0 - cx * f2;
+            const Real n2 = ixz * w0 + iyz * w1 + izz * w2 + cx * f1 - cy * f0;
+
+            // I * a the same way
+            const Real l0 = m * (a3 + a1 * cz - a2 * cy);
+            const Real l1 = m * (a4 + a2 * cx - a0 * cz);
+            const Real l2 = m * (a5 + a0 * cy - a1 * cx);
+
+            force[0][i] = ixx * a0 + ixy * a1 + ixz * a2 + cy * l2 - cz * l1 + w1 * n2 - w2 * n1 + v1 * f2 - v2 * f1;
+            force[1][i] = ixy * a0 + iyy * a1 + iyz * a2 + cz * l0 - cx * l2 + w2 * n0 - w0 * n2 + v2 * f0 - v0 * f2;
+            force[2][i] = ixz * a0 + iyz * a1 + izz * a2 + cx * l1 - cy * l0 + w0 * n1 - w1 * n0 + v0 * f1 - v1 * f0;
+            force[3][i] = l0 + w1 * f2 - w2 * f1;
+            force[4][i] = l1 + w2 * f0 - w0 * f2;
+            force[5][i] = l2 + w0 * f1 - w1 * f0;
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            for (uint32_t i = 0; i < batch_width; i++) batch.result[k][start + i] = force[k][i];
+        }
+    }
+}
+
 Vector6 calculateForwardDynamics(const RigidBodyState& rb, const Vector6& externalForces)
 {
-    return rb.spatial_inertia.inverse() * (externalForces - forceCrossProduct(rb.velocity, rb.spatial_inertia * rb.velocity));
+    return rb.spatial_inertia.solve(externalForces - ForceCross(rb.velocity, rb.spatial_inertia * rb.velocity));
+}
+
+Vector3 calculateImplicitGyroscopic(const Matrix3& inertia, const Vector3& omega, Real delta)
+{
+    // The residual at w and its Jacobian, d(w x Iw)/dw = [w]I - [Iw]
+    Vector3 momentum = inertia * omega;
+    Vector3 residual = delta * omega.cross(momentum);
+    Matrix3 jacobian = inertia + delta * (Skew(omega) * inertia - Skew(momentum));
+    return omega - jacobian.inverse() * residual;
 }
 
 Vector3 getLinearFromSpatial(const Vector6& spatial)
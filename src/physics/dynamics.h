@@ -4,11 +4,36 @@
 struct RigidBodyState
 {
     Vector6 velocity;
-    Eigen::Matrix<Real, 6, 6> spatial_inertia;
+    SpatialInertia spatial_inertia;
 };  
 
 Vector6 calculateInverseDynamics(const RigidBodyState& rb, const Vector6& desiredAcceleration, const Vector6& externalAcceleration);
 Vector6 calculateForwardDynamics(const RigidBodyState& rb, const Vector6& externalForces);
 
+// Torque free angular velocity (body space) after delta, from one Newton step on the implicit equation I (w' - w) + delta w' x I w' = 0
+// Unlike the explicit w x Iw term it can't add energy, so a fast spinning body stays stable at big time steps (it bleeds off a little instead)
+Vector3 calculateImplicitGyroscopic(const Matrix3& inertia, const Vector3& omega, Real delta);
+
+// Structure of arrays for running calculateInverseDynamics on many independent bodies at once (e.g. MPC rollouts)
+// Every pointer is one spatial component for all count instances: velocity[k][i] is component k of instance i
+// result can point at the same arrays as one of the inputs to compute in place
+struct InverseDynamicsBatch
+{
+    uint32_t count = 0;
+    const Real* velocity[6] = {};
+    const Real* desired_acceleration[6] = {};
+    const Real* external_acceleration[6] = {};
+
+    // Spatial inertias in the SpatialInertia form: mass, centre of mass and the inertia about it (xx yy zz xy xz yz, as in SymmetricMatrix3)
+    const Real* mass = nullptr;
+    const Real* center_of_mass[3] = {};
+    const Real* inertia[6] = {};
+
+    Real* result[6] = {};
+};
+
+// Same maths as calculateInverseDynamics, done a block of instances at a time so the compiler can vectorise across them
+void calculateInverseDynamicsBatch(const InverseDynamicsBatch& batch);
+
 Vector3 getLinearFromSpatial(const Vector6& spatial);
 Vector3 getAngularFromSpatial(const Vector6& spatial);
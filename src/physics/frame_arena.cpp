@@ -0,0 +1,73 @@
+#include "frame_arena.h"
+#include <algorithm>
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FrameArena::FrameArena(size_t initial_capacity)
+:capacity(initial_capacity)
+{
+    block = std::make_unique<std::byte[]>(capacity);
+    heap_allocations++;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    // Align the address, not the offset: new[] only promises max_align_t, so an offset that's a multiple of 64 isn't on a cache line
+    size_t base = reinterpret_cast<size_t>(block.get());
+    size_t start = AlignUp(base + offset, alignment) - base;
+    if (start + size <= capacity)
+    {
+        offset = start + size;
+        peak = std::max(peak, getUsed());
+        return block.get() + start;
+    }
+
+    // Out of room for this step, get through it with a separate block
+    overflow.push_back(std::make_unique<std::byte[]>(size + alignment));
+    overflow_bytes += size + alignment;
+    heap_allocations++;
+    peak = std::max(peak, getUsed());
+
+    size_t address = reinterpret_cast<size_t>(overflow.back().get());
+    return overflow.back().get() + (AlignUp(address, alignment) - address);
+}
+
+bool FrameArena::extend(void* data, size_t size, size_t new_size)
+{
+    std::byte* start = static_cast<std::byte*>(data);
+    if (start < block.get() || start + size != block.get() + offset) return false;
+
+    size_t start_offset = start - block.get();
+    if (start_offset + new_size > capacity) return false;
+
+    offset = start_offset + new_size;
+    peak = std::max(peak, getUsed());
+    return true;
+}
+
+void FrameArena::reserve(size_t size)
+{
+    if (size <= capacity || offset != 0 || !overflow.empty()) return;
+
+    capacity = AlignUp(size, 4096);
+    block = std::make_unique<std::byte[]>(capacity);
+    heap_allocations++;
+}
+
+void FrameArena::reset()
+{
+    // Grow the main block so the next step like this one fits without overflowing
+    if (!overflow.empty())
+    {
+        overflow.clear();
+        capacity = AlignUp(peak + peak / 2, 4096);
+        block = std::make_unique<std::byte[]>(capacity);
+        heap_allocations++;
+    }
+
+    offset = 0;
+    overflow_bytes = 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+    Linear allocator for data that only lives for one step (pairs, contacts, ...).
+    Allocating is a pointer bump and everything is freed at once by reset() at the end of the step.
+    If a step needs more than the main block, overflow blocks are allocated and the next reset() replaces them with one bigger main block,
+    so after a few warm-up steps a step doesn't touch the heap at all.
+*/
+
+class FrameArena
+{
+    private:
+        std::unique_ptr<std::byte[]> block;
+        size_t capacity = 0;
+        size_t offset = 0;
+
+        std::vector<std::unique_ptr<std::byte[]>> overflow;
+        size_t overflow_bytes = 0;
+
+        size_t peak = 0;
+        uint64_t heap_allocations = 0;
+
+    public:
+        FrameArena(size_t initial_capacity = 64 * 1024);
+
+        void* allocate(size_t size, size_t alignment);
+        void reset();
+
+        // Grows the main block to at least size bytes up front, only does anything between steps (when nothing is allocated)
+        void reserve(size_t size);
+
+        // Grows the last allocation in the main block in place, false if it isn't the last one or there's no room
+        bool extend(void* data, size_t size, size_t new_size);
+
+        size_t getCapacity() const { return capacity; }
+        size_t getUsed() const { return offset + overflow_bytes; }
+        size_t getPeak() const { return peak; }
+
+        // Number of times the arena itself went to the heap
+        uint64_t getHeapAllocations() const { return heap_allocations; }
+
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "Nothing in the frame arena gets destroyed");
+            return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        }
+};
+
+// Growable array in a FrameArena, only valid until the arena is reset
+// Growing extends in place when the array is the last allocation, otherwise it copies into a new range of the arena (the old range is just left until the reset)
+template <typename T>
+class FrameArray
+{
+    private:
+        FrameArena* arena = nullptr;
+        T* items = nullptr;
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+
+    public:
+        FrameArray() {}
+        FrameArray(FrameArena& arena)
+        :arena(&arena) {}
+
+        void reserve(uint32_t new_capacity)
+        {
+            if (new_capacity <= capacity) return;
+
+            // An array that's filled in one go (pairs, contacts) is usually the newest thing in the arena, so it can just take the space after it
+            if (items && arena->extend(items, sizeof(T) * capacity, sizeof(T) * new_capacity))
+            {
+                capacity = new_capacity;
+                return;
+            }
+
+            T* new_items = arena->allocate<T>(new_capacity);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                new (&new_items[i]) T(items[i]);
+            }
+            items = new_items;
+            capacity = new_capacity;
+        }
+
+        void push_back(const T& item)
+        {
+            if (count == capacity)
+            {
+                // Doubled in 64 bits so a huge array tops out at the uint32 limit instead of wrapping around to a tiny capacity
+                if (count == UINT32_MAX) throw std::length_error("FrameArray is full");
+                reserve(capacity < 16 ? 16 : static_cast<uint32_t>(std::min<uint64_t>(capacity * uint64_t(2), UINT32_MAX)));
+            }
+            new (&items[count++]) T(item);
+        }
+
+        // Drops the items and the storage, call before the arena is reset
+        void release()
+        {
+            items = nullptr;
+            count = 0;
+            capacity = 0;
+        }
+
+        uint32_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T& operator[](uint32_t index) { return items[index]; }
+        const T& operator[](uint32_t index) const { return items[index]; }
+
+        T* begin() { return items; }
+        T* end() { return items + count; }
+        const T* begin() const { return items; }
+        const T* end() const { return items + count; }
+};
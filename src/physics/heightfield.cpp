@@ -0,0 +1,100 @@
+#include "heightfield.h"
+#include <cmath>
+#include <limits>
+
+// Round so the float range always contains the real range
+static float roundDown(Real value)
+{
+    float result = static_cast<float>(value);
+    return (result > value) ? std::nextafter(result, -std::numeric_limits<float>::infinity()) : result;
+}
+
+static float roundUp(Real value)
+{
+    float result = static_cast<float>(value);
+    return (result < value) ? std::nextafter(result, std::numeric_limits<float>::infinity()) : result;
+}
+
+HeightField::HeightField(uint32_t columns, uint32_t rows, const Vector2& cell_size, const std::vector<Real>& source_heights, bool quantise)
+:columns(columns), rows(rows), cell_size(cell_size)
+{
+    if (columns < 2 || rows < 2 || source_heights.size() < columns * rows) return;
+
+    origin = Vector2(-0.5 * (columns - 1) * cell_size[0], -0.5 * (rows - 1) * cell_size[1]);
+
+    if (quantise)
+    {
+        Real min_height = *std::min_element(source_heights.begin(), source_heights.begin() + columns * rows);
+        Real max_height = *std::max_element(source_heights.begin(), source_heights.begin() + columns * rows);
+
+        height_offset = min_height;
+        height_scale = (max_height > min_height) ? (max_height - min_height) / 65535.0 : 1.0;
+
+        quantised_heights.resize(columns * rows);
+        for (uint32_t i = 0; i < columns * rows; i++)
+        {
+            quantised_heights[i] = static_cast<uint16_t>(std::lround((source_heights[i] - height_offset) / height_scale));
+        }
+    }
+    else
+    {
+        heights.assign(source_heights.begin(), source_heights.begin() + columns * rows);
+    }
+
+    buildPyramid();
+}
+
+void HeightField::buildPyramid()
+{
+    // Level 0 from the cell corners
+    uint32_t level_columns = columns - 1;
+    uint32_t level_rows = rows - 1;
+    levels.push_back(PyramidLevel{ .offset = 0, .columns = level_columns, .rows = level_rows });
+
+    ranges.resize(level_columns * level_rows);
+    for (uint32_t z = 0; z < level_rows; z++)
+    {
+        for (uint32_t x = 0; x < level_columns; x++)
+        {
+            Real h00 = getHeight(x, z);
+            Real h10 = getHeight(x + 1, z);
+            Real h01 = getHeight(x, z + 1);
+            Real h11 = getHeight(x + 1, z + 1);
+            ranges[z * level_columns + x] = HeightRange{
+                .min = roundDown(std::min({h00, h10, h01, h11})),
+                .max = roundUp(std::max({h00, h10, h01, h11}))
+            };
+        }
+    }
+
+    // Halve until a single block covers the whole field
+    while (level_columns > 1 || level_rows > 1)
+    {
+        const PyramidLevel child = levels.back();
+        level_columns = (child.columns + 1) / 2;
+        level_rows = (child.rows + 1) / 2;
+
+        PyramidLevel level = { .offset = static_cast<uint32_t>(ranges.size()), .columns = level_columns, .rows = level_rows };
+        ranges.resize(ranges.size() + level_columns * level_rows);
+
+        for (uint32_t z = 0; z < level_rows; z++)
+        {
+            for (uint32_t x = 0; x < level_columns; x++)
+            {
+                HeightRange range = { .min = std::numeric_limits<float>::max(), .max = std::numeric_limits<float>::lowest() };
+                for (uint32_t j = z * 2; j < std::min(z * 2 + 2, child.rows); j++)
+                {
+                    for (uint32_t i = x * 2; i < std::min(x * 2 + 2, child.columns); i++)
+                    {
+                        const HeightRange& child_range = ranges[child.offset + j * child.columns + i];
+                        range.min = std::min(range.min, child_range.min);
+                        range.max = std::max(range.max, child_range.max);
+                    }
+                }
+                ranges[level.offset + z * level_columns + x] = range;
+            }
+        }
+
+        levels.push_back(level);
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "physics.h"
+#include <cstdint>
+#include <algorithm>
+
+/*
+    Static terrain made from a regular grid of heights.
+    The grid is centered on the body's position in x and z with heights along the body's local y axis (the solid side is below).
+    Samples are row major: heights[z * columns + x].
+*/
+
+struct HeightRange
+{
+    float min;
+    float max;
+};
+
+class HeightField
+{
+    private:
+        uint32_t columns = 0;
+        uint32_t rows = 0;
+        Vector2 cell_size = Vector2::Ones();
+        Vector2 origin = Vector2::Zero();
+
+        // Only one of these is filled depending on whether the heights were quantised
+        std::vector<float> heights;
+        std::vector<uint16_t> quantised_heights;
+        Real height_offset = 0.0;
+        Real height_scale = 1.0;
+
+        // Min/max pyramid: level 0 has one range per cell, every level above covers 2x2 blocks of the one below
+        struct PyramidLevel
+        {
+            uint32_t offset;
+            uint32_t columns;
+            uint32_t rows;
+        };
+        std::vector<PyramidLevel> levels;
+        std::vector<HeightRange> ranges;
+
+        static constexpr uint32_t max_stack = 128;
+
+        void buildPyramid();
+
+    public:
+        HeightField(uint32_t columns, uint32_t rows, const Vector2& cell_size, const std::vector<Real>& heights, bool quantise = false);
+
+        uint32_t getColumns() const { return columns; }
+        uint32_t getRows() const { return rows; }
+        Vector2 getCellSize() const { return cell_size; }
+        bool isQuantised() const { return !quantised_heights.empty(); }
+
+        Real getHeight(uint32_t x, uint32_t z) const
+        {
+            uint32_t index = z * columns + x;
+            return quantised_heights.empty() ? heights[index] : height_offset + quantised_heights[index] * height_scale;
+        }
+
+        Vector3 getVertex(uint32_t x, uint32_t z) const
+        {
+            return Vector3(origin[0] + x * cell_size[0], getHeight(x, z), origin[1] + z * cell_size[1]);
+        }
+
+        HeightRange getBounds() const { return ranges.empty() ? HeightRange{ 0.0f, 0.0f } : ranges.back(); }
+
+        // Calls func(const Vector3* triangle) for both triangles of every cell under [min, max] (in x and z) whose heights reach min.y
+        // Triangles are wound so their normals point up out of the terrain
+        template <typename Func>
+        void queryTriangles(const Vector3& min, const Vector3& max, Func&& func) const;
+};
+
+template <typename Func>
+void HeightField::queryTriangles(const Vector3& min, const Vector3& max, Func&& func) const
+{
+    if (levels.empty()) return;
+
+    // Cell range under the query bounds
+    Real x_start = std::floor((min[0] - origin[0]) / cell_size[0]);
+    Real x_end = std::floor((max[0] - origin[0]) / cell_size[0]);
+    Real z_start = std::floor((min[2] - origin[1]) / cell_size[1]);
+    Real z_end = std::floor((max[2] - origin[1]) / cell_size[1]);
+
+    Real last_column = static_cast<Real>(columns - 2);
+    Real last_row = static_cast<Real>(rows - 2);
+    if (x_end < 0.0 || z_end < 0.0 || x_start > last_column || z_start > last_row) return;
+
+    uint32_t cell_x0 = static_cast<uint32_t>(std::max(x_start, Real(0.0)));
+    uint32_t cell_x1 = static_cast<uint32_t>(std::min(x_end, last_column));
+    uint32_t cell_z0 = static_cast<uint32_t>(std::max(z_start, Real(0.0)));
+    uint32_t cell_z1 = static_cast<uint32_t>(std::min(z_end, last_row));
+
+    // Walk down the pyramid from the single top block, dropping blocks that are entirely below the query
+    struct Block { uint32_t level, x, z; };
+    Block stack[max_stack];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = Block{ static_cast<uint32_t>(levels.size() - 1), 0, 0 };
+
+    Vector3 triangle[3];
+    while (stack_size > 0)
+    {
+        Block block = stack[--stack_size];
+        const PyramidLevel& level = levels[block.level];
+        if (block.x >= level.columns || block.z >= level.rows) continue;
+
+        // Cells covered by this block
+        uint32_t block_x0 = block.x << block.level;
+        uint32_t block_x1 = ((block.x + 1) << block.level) - 1;
+        uint32_t block_z0 = block.z << block.level;
+        uint32_t block_z1 = ((block.z + 1) << block.level) - 1;
+        if (block_x0 > cell_x1 || block_x1 < cell_x0 || block_z0 > cell_z1 || block_z1 < cell_z0) continue;
+
+        if (ranges[level.offset + block.z * level.columns + block.x].max < min[1]) continue;
+
+        if (block.level > 0)
+        {
+            uint32_t child_level = block.level - 1;
+            stack[stack_size++] = Block{ child_level, block.x * 2, block.z * 2 };
+            stack[stack_size++] = Block{ child_level, block.x * 2 + 1, block.z * 2 };
+            stack[stack_size++] = Block{ child_level, block.x * 2, block.z * 2 + 1 };
+            stack[stack_size++] = Block{ child_level, block.x * 2 + 1, block.z * 2 + 1 };
+            continue;
+        }
+
+        Vector3 p00 = getVertex(block.x, block.z);
+        Vector3 p10 = getVertex(block.x + 1, block.z);
+        Vector3 p01 = getVertex(block.x, block.z + 1);
+        Vector3 p11 = getVertex(block.x + 1, block.z + 1);
+
+        triangle[0] = p00; triangle[1] = p01; triangle[2] = p10;
+        func(static_cast<const Vector3*>(triangle));
+
+        triangle[0] = p10; triangle[1] = p01; triangle[2] = p11;
+        func(static_cast<const Vector3*>(triangle));
+    }
+}
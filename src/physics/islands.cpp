@@ -0,0 +1,158 @@
+/*
+    Simulation islands and the adaptive solver loops.
+
+    Islands are rebuilt every step with a union-find over the dynamic bodies (static and kinematic bodies can't pass an impulse on, so a floor
+    doesn't join everything on it into one island). Each island's joints and contacts are then solved on their own, in the same relative order
+    as the global loop, and each island stops iterating as soon as an iteration barely changes anything. A ball resting on the floor takes an
+    iteration or two while a big stack next to it still gets the full limit.
+    All the island arrays live in the frame arena.
+*/
+
+#include "physics.h"
+#include <algorithm>
+
+static BodyID FindRoot(FrameArray<BodyID>& parents, BodyID id)
+{
+    while (parents[id] != id)
+    {
+        parents[id] = parents[parents[id]];  // Path halving
+        id = parents[id];
+    }
+    return id;
+}
+
+void PhysicsWorld::buildIslands()
+{
+    islands = FrameArray<Island>(frame_arena);
+    island_joints = FrameArray<uint32_t>(frame_arena);
+    island_collisions = FrameArray<uint32_t>(frame_arena);
+
+    FrameArray<BodyID> parents(frame_arena);
+    parents.reserve(bodies.size());
+    for (BodyID i = 0; i < static_cast<BodyID>(bodies.size()); i++)
+    {
+        parents.push_back(i);
+    }
+
+    auto is_dynamic = [&](BodyID id) { return bodies[id].layer == PhysicsLayer::DYNAMIC; };
+    auto join = [&](BodyID a, BodyID b) {
+        if (!is_dynamic(a) || !is_dynamic(b)) return;
+        a = FindRoot(parents, a);
+        b = FindRoot(parents, b);
+        if (a != b) parents[std::max(a, b)] = std::min(a, b);
+    };
+
+    for (const PhysicsJoint& joint : joints)
+    {
+        join(joint.a, joint.b);
+    }
+    for (const Collision& collision : collisions)
+    {
+        join(collision.a, collision.b);
+    }
+
+    // Islands are numbered in the order their first constraint shows up, then the constraints are bucketed by island (a counting sort, so
+    // each island keeps the global order). Constraints with no dynamic body have nothing to solve and go nowhere
+    FrameArray<int32_t> island_ids(frame_arena);
+    island_ids.reserve(bodies.size());
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        island_ids.push_back(-1);
+    }
+
+    auto get_island = [&](BodyID a, BodyID b) -> int32_t {
+        BodyID body = is_dynamic(a) ? a : (is_dynamic(b) ? b : -1);
+        if (body < 0) return -1;
+
+        BodyID root = FindRoot(parents, body);
+        if (island_ids[root] < 0)
+        {
+            island_ids[root] = static_cast<int32_t>(islands.size());
+            islands.push_back(Island{});
+        }
+        return island_ids[root];
+    };
+
+    for (const PhysicsJoint& joint : joints)
+    {
+        int32_t island = get_island(joint.a, joint.b);
+        if (island >= 0) islands[island].joint_count++;
+    }
+    for (const Collision& collision : collisions)
+    {
+        int32_t island = get_island(collision.a, collision.b);
+        if (island >= 0) islands[island].collision_count++;
+    }
+
+    uint32_t joint_total = 0;
+    uint32_t collision_total = 0;
+    for (Island& island : islands)
+    {
+        island.joint_start = joint_total;
+        island.collision_start = collision_total;
+        joint_total += island.joint_count;
+        collision_total += island.collision_count;
+        island.joint_count = 0;
+        island.collision_count = 0;
+    }
+
+    island_joints.reserve(joint_total);
+    island_collisions.reserve(collision_total);
+    for (uint32_t i = 0; i < joint_total; i++)
+    {
+        island_joints.push_back(0);
+    }
+    for (uint32_t i = 0; i < collision_total; i++)
+    {
+        island_collisions.push_back(0);
+    }
+
+    for (uint32_t i = 0; i < joints.size(); i++)
+    {
+        int32_t island = get_island(joints[i].a, joints[i].b);
+        if (island < 0) continue;
+        island_joints[islands[island].joint_start + islands[island].joint_count++] = i;
+    }
+    for (uint32_t i = 0; i < collisions.size(); i++)
+    {
+        int32_t island = get_island(collisions[i].a, collisions[i].b);
+        if (island < 0) continue;
+        island_collisions[islands[island].collision_start + islands[island].collision_count++] = i;
+    }
+}
+
+// Returns the number of iterations the island needed
+uint32_t PhysicsWorld::solveIslandVelocities(const Island& island, Real delta)
+{
+    for (uint32_t i = 0; i < collisionVelocityIterations; i++)
+    {
+        Real residual = 0.0;
+        for (uint32_t j = 0; j < island.joint_count; j++)
+        {
+            residual = std::max(residual, handleJointVelocities(joints[island_joints[island.joint_start + j]]));
+        }
+
+        for (uint32_t j = 0; j < island.collision_count; j++)
+        {
+            residual = std::max(residual, handleCollisionVelocities(collisions[island_collisions[island.collision_start + j]], delta));
+        }
+
+        if (residual < velocity_tolerance) return i + 1;
+    }
+    return collisionVelocityIterations;
+}
+
+uint32_t PhysicsWorld::solveIslandPositions(const Island& island)
+{
+    for (uint32_t i = 0; i < collisionPositionIterations; i++)
+    {
+        Real residual = 0.0;
+        for (uint32_t j = 0; j < island.collision_count; j++)
+        {
+            residual = std::max(residual, handleCollisionPositions(collisions[island_collisions[island.collision_start + j]]));
+        }
+
+        if (residual < penetration_tolerance) return i + 1;
+    }
+    return collisionPositionIterations;
+}
@@ -0,0 +1,257 @@
+/*
+    Joints.
+
+    Every joint is a handful of scalar rows (3 for a ball socket, 5 for a hinge, 6 for a fixed joint, 1 for a distance joint) that are solved
+    alongside the contacts in the velocity iterations. The rows are built once per step in world space (against the solver bodies) with the
+    inverse inertias already applied (JointRow::response), so the iterations need no rotations or inertia products.
+    All of a joint's rows are solved together with the inverse of their effective mass matrix (also built once per step) instead of one row at
+    a time, otherwise the rows fight each other and a light body between heavy ones (a rod holding a weight) never settles in 10 iterations.
+    Drift is pulled back with the same Baumgarte term the contacts use.
+
+    Rows keep their index from step to step (linear rows are along the world axes, angular rows come from the hinge axis) so the impulses
+    from the last step are a good first guess for this one, they're applied up front and the iterations only have to fix up the difference.
+*/
+
+#include "physics.h"
+#include <algorithm>
+
+static uint64_t GetJointPairKey(BodyID a, BodyID b)
+{
+    if (a > b) std::swap(a, b);
+    return (static_cast<uint64_t>(static_cast<uint32_t>(a)) << 32) | static_cast<uint32_t>(b);
+}
+
+// Keeps the anchors (radius_a / radius_b from each centre of mass, in world space) from moving apart along a world direction
+static void MakeLinearRow(JointRow& row, const Vector3& radius_a, const Vector3& radius_b, const Vector3& direction)
+{
+    row.jacobian_a << -radius_a.cross(direction), -direction;
+    row.jacobian_b << radius_b.cross(direction), direction;
+}
+
+// Stops relative rotation about a world direction
+static void MakeAngularRow(JointRow& row, const Vector3& direction)
+{
+    row.jacobian_a << -direction, Vector3::Zero();
+    row.jacobian_b << direction, Vector3::Zero();
+}
+
+static void GetPerpendicularAxes(const Vector3& axis, Vector3& t1, Vector3& t2)
+{
+    t1 = (std::abs(axis[0]) < 0.57) ? axis.cross(Vector3::UnitX()) : axis.cross(Vector3::UnitY());
+    t1.normalize();
+    t2 = axis.cross(t1);
+}
+
+JointID PhysicsWorld::addJoint(const PhysicsJoint& joint)
+{
+    JointID id = joints.size();
+    joints.push_back(joint);
+
+    uint64_t key = GetJointPairKey(joint.a, joint.b);
+    joint_pairs.insert(std::lower_bound(joint_pairs.begin(), joint_pairs.end(), key), key);
+    return id;
+}
+
+// For when joints is replaced wholesale (snapshot restore)
+void PhysicsWorld::rebuildJointPairs()
+{
+    joint_pairs.clear();
+    for (const PhysicsJoint& joint : joints) joint_pairs.push_back(GetJointPairKey(joint.a, joint.b));
+    std::sort(joint_pairs.begin(), joint_pairs.end());
+}
+
+bool PhysicsWorld::isJointed(BodyID a, BodyID b) const
+{
+    return std::binary_search(joint_pairs.begin(), joint_pairs.end(), GetJointPairKey(a, b));
+}
+
+JointID PhysicsWorld::createBallJoint(BodyID a, BodyID b, const Vector3& anchor)
+{
+    if (a < 0 || a >= bodies.size() || b < 0 || b >= bodies.size() || a == b) return -1;
+
+    const Transform& a_transform = bodies[a].transform;
+    const Transform& b_transform = bodies[b].transform;
+    return addJoint(PhysicsJoint{
+        .type = JointType::BALL_SOCKET,
+        .a = a,
+        .b = b,
+        .anchor_a = a_transform.orientation.inverse() * (anchor - a_transform.position),
+        .anchor_b = b_transform.orientation.inverse() * (anchor - b_transform.position)
+    });
+}
+
+JointID PhysicsWorld::createHingeJoint(BodyID a, BodyID b, const Vector3& anchor, const Vector3& axis)
+{
+    if (a < 0 || a >= bodies.size() || b < 0 || b >= bodies.size() || a == b) return -1;
+
+    const Transform& a_transform = bodies[a].transform;
+    const Transform& b_transform = bodies[b].transform;
+    return addJoint(PhysicsJoint{
+        .type = JointType::HINGE,
+        .a = a,
+        .b = b,
+        .anchor_a = a_transform.orientation.inverse() * (anchor - a_transform.position),
+        .anchor_b = b_transform.orientation.inverse() * (anchor - b_transform.position),
+        .axis_a = a_transform.orientation.inverse() * axis.normalized(),
+        .axis_b = b_transform.orientation.inverse() * axis.normalized()
+    });
+}
+
+// The anchor is b's origin, so the rows pin b's centre of mass and orientation to a
+JointID PhysicsWorld::createFixedJoint(BodyID a, BodyID b)
+{
+    if (a < 0 || a >= bodies.size() || b < 0 || b >= bodies.size() || a == b) return -1;
+
+    const Transform& a_transform = bodies[a].transform;
+    const Transform& b_transform = bodies[b].transform;
+    return addJoint(PhysicsJoint{
+        .type = JointType::FIXED,
+        .a = a,
+        .b = b,
+        .anchor_a = a_transform.orientation.inverse() * (b_transform.position - a_transform.position),
+        .anchor_b = Vector3::Zero(),
+        .rest_orientation = a_transform.orientation.inverse() * b_transform.orientation
+    });
+}
+
+JointID PhysicsWorld::createDistanceJoint(BodyID a, BodyID b, const Vector3& anchor_a, const Vector3& anchor_b)
+{
+    if (a < 0 || a >= bodies.size() || b < 0 || b >= bodies.size() || a == b) return -1;
+
+    const Transform& a_transform = bodies[a].transform;
+    const Transform& b_transform = bodies[b].transform;
+    return addJoint(PhysicsJoint{
+        .type = JointType::DISTANCE,
+        .a = a,
+        .b = b,
+        .anchor_a = a_transform.orientation.inverse() * (anchor_a - a_transform.position),
+        .anchor_b = b_transform.orientation.inverse() * (anchor_b - b_transform.position),
+        .distance = (anchor_b - anchor_a).norm()
+    });
+}
+
+uint32_t PhysicsWorld::getJointCount() const
+{
+    return static_cast<uint32_t>(joints.size());
+}
+
+// Builds the rows from the current transforms, then applies last step's impulses (warm starting)
+void PhysicsWorld::prepareJoint(PhysicsJoint& joint, Real delta)
+{
+    const PhysicsBody& a = bodies[joint.a];
+    const PhysicsBody& b = bodies[joint.b];
+    SolverBody& a_solver = solver_bodies[joint.a];
+    SolverBody& b_solver = solver_bodies[joint.b];
+
+    Vector3 radius_a = a.transform.orientation * joint.anchor_a;
+    Vector3 radius_b = b.transform.orientation * joint.anchor_b;
+    Vector3 separation = (b.transform.position + radius_b) - (a.transform.position + radius_a);
+
+    // Position error for every row, turned into a bias velocity below
+    Real error[MAX_JOINT_ROWS] = {};
+    uint32_t count = 0;
+
+    if (joint.type == JointType::DISTANCE)
+    {
+        Real length = separation.norm();
+        Vector3 direction = length > 1e-9 ? Vector3(separation / length) : Vector3::UnitY();
+        MakeLinearRow(joint.rows[count], radius_a, radius_b, direction);
+        error[count++] = length - joint.distance;
+    }
+    else
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            MakeLinearRow(joint.rows[count], radius_a, radius_b, Vector3::Unit(i));
+            error[count++] = separation[i];
+        }
+    }
+
+    if (joint.type == JointType::HINGE)
+    {
+        // a x b is (to first order) the rotation that would line b's axis back up with a's, so its part off the axis is the error
+        Vector3 axis_a = a.transform.orientation * joint.axis_a;
+        Vector3 axis_b = b.transform.orientation * joint.axis_b;
+
+        // The rows are picked in a's space and turn with it. Picking them from the world axis would switch basis as the axis swings past
+        // the cutoff in GetPerpendicularAxes, and the warm start impulses would then push along the wrong directions
+        Vector3 t1, t2;
+        GetPerpendicularAxes(joint.axis_a, t1, t2);
+        t1 = a.transform.orientation * t1;
+        t2 = a.transform.orientation * t2;
+        Vector3 misalignment = axis_a.cross(axis_b);
+
+        MakeAngularRow(joint.rows[count], t1);
+        error[count++] = t1.dot(misalignment);
+        MakeAngularRow(joint.rows[count], t2);
+        error[count++] = t2.dot(misalignment);
+    }
+    else if (joint.type == JointType::FIXED)
+    {
+        Quaternion orientation_error = b.transform.orientation * (a.transform.orientation * joint.rest_orientation).inverse();
+        if (orientation_error.w() < 0.0) orientation_error.coeffs() = -orientation_error.coeffs();
+        Vector3 rotation_error = 2.0 * orientation_error.vec();
+
+        for (int i = 0; i < 3; i++)
+        {
+            MakeAngularRow(joint.rows[count], Vector3::Unit(i));
+            error[count++] = rotation_error[i];
+        }
+    }
+    joint.row_count = count;
+
+    Real baumgarte = 0.2;
+
+    // Unused rows are left as identity so the inverse of the padded matrix is still the inverse of the used block
+    Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS> mass_matrix = Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS>::Identity();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        JointRow& row = joint.rows[i];
+        row.response_a << a_solver.inverse_inertia * row.jacobian_a.head<3>(), a_solver.inverse_mass * row.jacobian_a.tail<3>();
+        row.response_b << b_solver.inverse_inertia * row.jacobian_b.head<3>(), b_solver.inverse_mass * row.jacobian_b.tail<3>();
+        row.bias = baumgarte * error[i] / delta;
+
+        a_solver.velocity += row.response_a * joint.accumulated_impulses[i];
+        b_solver.velocity += row.response_b * joint.accumulated_impulses[i];
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t j = i; j < count; j++)
+        {
+            mass_matrix(i, j) = joint.rows[i].jacobian_a.dot(joint.rows[j].response_a) + joint.rows[i].jacobian_b.dot(joint.rows[j].response_b);
+            mass_matrix(j, i) = mass_matrix(i, j);
+        }
+    }
+
+    // Nothing to move if neither body is dynamic
+    bool movable = a_solver.inverse_mass > 0.0 || b_solver.inverse_mass > 0.0;
+    joint.effective_mass = movable ? Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS>(mass_matrix.inverse()) : Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS>::Zero();
+}
+
+// Joints are two sided (no clamping) so the accumulated impulses are only kept for warm starting
+// Without the bias only the velocity error is removed (the relax pass when sub-stepping)
+// The block solve takes out the whole velocity error, so the largest row error is also the largest velocity change (the residual)
+Real PhysicsWorld::handleJointVelocities(PhysicsJoint& joint, bool use_bias)
+{
+    Vector6& a_velocity = solver_bodies[joint.a].velocity;
+    Vector6& b_velocity = solver_bodies[joint.b].velocity;
+
+    Eigen::Matrix<Real, MAX_JOINT_ROWS, 1> velocity_error = Eigen::Matrix<Real, MAX_JOINT_ROWS, 1>::Zero();
+    Real residual = 0.0;
+    for (uint32_t i = 0; i < joint.row_count; i++)
+    {
+        const JointRow& row = joint.rows[i];
+        velocity_error[i] = row.jacobian_a.dot(a_velocity) + row.jacobian_b.dot(b_velocity) + (use_bias ? row.bias : 0.0);
+        residual = std::max(residual, std::abs(velocity_error[i]));
+    }
+
+    Eigen::Matrix<Real, MAX_JOINT_ROWS, 1> impulses = -(joint.effective_mass * velocity_error);
+    for (uint32_t i = 0; i < joint.row_count; i++)
+    {
+        joint.accumulated_impulses[i] += impulses[i];
+        a_velocity += joint.rows[i].response_a * impulses[i];
+        b_velocity += joint.rows[i].response_b * impulses[i];
+    }
+
+    return residual;
+}
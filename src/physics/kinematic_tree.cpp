@@ -0,0 +1,318 @@
+#include "kinematic_tree.h"
+#include "dynamics.h"
+#include "trace.h"
+
+static uint32_t GetJointDoF(TreeJointType type)
+{
+    return type == TreeJointType::SPHERICAL ? 3 : 1;
+}
+
+static uint32_t GetJointPositionCount(TreeJointType type)
+{
+    return type == TreeJointType::SPHERICAL ? 4 : 1;
+}
+
+// Joint quantities are padded to 3 so every joint type goes through the same fixed size maths (unused entries stay 0)
+static Vector3 ReadJointVector(const VectorX& data, uint32_t offset, uint32_t dof)
+{
+    Vector3 value = Vector3::Zero();
+    for (uint32_t i = 0; i < dof; i++) value[i] = data[offset + i];
+    return value;
+}
+
+static void WriteJointVector(VectorX& data, uint32_t offset, uint32_t dof, const Vector3& value)
+{
+    for (uint32_t i = 0; i < dof; i++) data[offset + i] = value[i];
+}
+
+int32_t KinematicTree::addLink(int32_t parent, TreeJointType type, const Vector3& axis, const Transform& joint_frame, const PhysicsShape& shape, Real mass, const Vector3& center_of_mass)
+{
+    int32_t id = static_cast<int32_t>(parents.size());
+    if (parent >= id) return -1;
+
+    parents.push_back(parent < 0 ? -1 : parent);
+    joint_types.push_back(type);
+    joint_axes.push_back(axis.normalized());
+    joint_frames.push_back(joint_frame);
+
+    SpatialInertia inertia = SpatialInertia::FromMatrix(GetSpatialInertia(shape, mass));
+    inertia.center_of_mass = center_of_mass;
+    inertias.push_back(inertia);
+
+    Eigen::Matrix<Real, 6, 3> subspace = Eigen::Matrix<Real, 6, 3>::Zero();
+    switch (type)
+    {
+        case TreeJointType::REVOLUTE:
+            subspace.block<3, 1>(0, 0) = joint_axes.back();
+            break;
+        case TreeJointType::PRISMATIC:
+            subspace.block<3, 1>(3, 0) = joint_axes.back();
+            break;
+        case TreeJointType::SPHERICAL:
+            subspace.topRows<3>() = Matrix3::Identity();
+            break;
+    }
+    motion_subspaces.push_back(subspace);
+
+    uint32_t position_offset = static_cast<uint32_t>(positions.size());
+    uint32_t velocity_offset = static_cast<uint32_t>(velocities.size());
+    position_offsets.push_back(position_offset);
+    velocity_offsets.push_back(velocity_offset);
+
+    positions.conservativeResize(position_offset + GetJointPositionCount(type));
+    velocities.conservativeResize(velocity_offset + GetJointDoF(type));
+    accelerations.conservativeResize(velocities.size());
+    torques.conservativeResize(velocities.size());
+
+    positions.tail(GetJointPositionCount(type)).setZero();
+    if (type == TreeJointType::SPHERICAL) positions[position_offset + 3] = 1.0;
+    velocities.tail(GetJointDoF(type)).setZero();
+    accelerations.tail(GetJointDoF(type)).setZero();
+    torques.tail(GetJointDoF(type)).setZero();
+
+    parent_transforms.push_back(SpatialTransform{});
+    link_velocities.push_back(Vector6::Zero());
+    link_accelerations.push_back(Vector6::Zero());
+    bias_accelerations.push_back(Vector6::Zero());
+    bias_forces.push_back(Vector6::Zero());
+    articulated_inertias.push_back(SpatialMatrix::Zero());
+    projected_inertias.push_back(Eigen::Matrix<Real, 6, 3>::Zero());
+    inverse_joint_inertias.push_back(Matrix3::Identity());
+    projected_forces.push_back(Vector3::Zero());
+    link_transforms.push_back(Transform{});
+
+    calculateJointTransforms();
+    return id;
+}
+
+void KinematicTree::setJointPositions(const VectorX& q)
+{
+    if (q.size() == positions.size()) positions = q;
+}
+
+void KinematicTree::setJointVelocities(const VectorX& qd)
+{
+    if (qd.size() == velocities.size()) velocities = qd;
+}
+
+void KinematicTree::setJointTorques(const VectorX& tau)
+{
+    if (tau.size() == torques.size()) torques = tau;
+}
+
+void KinematicTree::setBaseTransform(const Transform& transform)
+{
+    base = transform;
+    calculateJointTransforms();
+}
+
+void KinematicTree::setGravity(const Vector6& grav)
+{
+    grav_acceleration = grav;
+}
+
+// Parent to link transforms for the current joint positions, plus every link's world transform
+void KinematicTree::calculateJointTransforms()
+{
+    for (uint32_t i = 0; i < parents.size(); i++)
+    {
+        const Transform& frame = joint_frames[i];
+        uint32_t offset = position_offsets[i];
+
+        Quaternion joint_rotation = Quaternion::Identity();
+        Vector3 joint_translation = Vector3::Zero();
+        switch (joint_types[i])
+        {
+            case TreeJointType::REVOLUTE:
+                joint_rotation = Quaternion(Eigen::AngleAxis<Real>(positions[offset], joint_axes[i]));
+                break;
+            case TreeJointType::PRISMATIC:
+                joint_translation = joint_axes[i] * positions[offset];
+                break;
+            case TreeJointType::SPHERICAL:
+                joint_rotation = Quaternion(positions[offset + 3], positions[offset], positions[offset + 1], positions[offset + 2]).normalized();
+                break;
+        }
+
+        // Link frame relative to the parent frame
+        Quaternion orientation = frame.orientation * joint_rotation;
+        Vector3 translation = frame.position + frame.orientation * joint_translation;
+        parent_transforms[i] = SpatialTransform{ .rotation = orientation.toRotationMatrix().transpose(), .translation = translation };
+
+        const Transform& parent = parents[i] < 0 ? base : link_transforms[parents[i]];
+        link_transforms[i].position = parent.position + parent.orientation * translation;
+        link_transforms[i].orientation = (parent.orientation * orientation).normalized();
+    }
+}
+
+// Gravity is applied by accelerating the base the opposite way, which saves a force per link
+Vector6 KinematicTree::getRootAcceleration() const
+{
+    Quaternion inverse_orientation = base.orientation.inverse();
+    Vector6 acceleration;
+    acceleration << inverse_orientation * -getAngularFromSpatial(grav_acceleration), inverse_orientation * -getLinearFromSpatial(grav_acceleration);
+    return acceleration;
+}
+
+void KinematicTree::calculateForwardDynamics()
+{
+    PHYSICS_TRACE_SCOPE("KinematicTree::calculateForwardDynamics");
+    calculateJointTransforms();
+    uint32_t count = static_cast<uint32_t>(parents.size());
+
+    // Pass 1 (root to leaves): link velocities, velocity product accelerations and the rigid body bias forces
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const Eigen::Matrix<Real, 6, 3>& subspace = motion_subspaces[i];
+        Vector6 joint_velocity = subspace * ReadJointVector(velocities, velocity_offsets[i], GetJointDoF(joint_types[i]));
+
+        Vector6 velocity = joint_velocity;
+        if (parents[i] >= 0) velocity += parent_transforms[i].apply(link_velocities[parents[i]]);
+
+        link_velocities[i] = velocity;
+        bias_accelerations[i] = MotionCross(velocity, joint_velocity);
+        articulated_inertias[i] = inertias[i].toMatrix();
+        bias_forces[i] = ForceCross(velocity, inertias[i] * velocity);
+    }
+
+    // Pass 2 (leaves to root): articulated inertias and bias forces, each link hands what its joint can't absorb to its parent
+    for (int32_t i = static_cast<int32_t>(count) - 1; i >= 0; i--)
+    {
+        uint32_t dof = GetJointDoF(joint_types[i]);
+        const Eigen::Matrix<Real, 6, 3>& subspace = motion_subspaces[i];
+        Vector3 torque = ReadJointVector(torques, velocity_offsets[i], dof);
+
+        // Unused DoFs are padded with identity in the 3x3 joint inertia so its inverse is always defined (they get 0 acceleration)
+        Eigen::Matrix<Real, 6, 3> projected_inertia = Eigen::Matrix<Real, 6, 3>::Zero();
+        Matrix3 inverse_joint_inertia = Matrix3::Identity();
+        Vector3 projected_force = Vector3::Zero();
+        if (dof == 1)
+        {
+            // Most joints are 1 DoF, where everything collapses to a 6 vector and a scalar
+            Vector6 s = subspace.col(0);
+            projected_inertia.col(0) = articulated_inertias[i] * s;
+            inverse_joint_inertia(0, 0) = 1.0 / s.dot(projected_inertia.col(0));
+            projected_force[0] = torque[0] - s.dot(bias_forces[i]);
+        }
+        else
+        {
+            projected_inertia = articulated_inertias[i] * subspace;
+            inverse_joint_inertia = (subspace.transpose() * projected_inertia).inverse();
+            projected_force = torque - subspace.transpose() * bias_forces[i];
+        }
+
+        projected_inertias[i] = projected_inertia;
+        inverse_joint_inertias[i] = inverse_joint_inertia;
+        projected_forces[i] = projected_force;
+
+        int32_t parent = parents[i];
+        if (parent < 0) continue;
+
+        SpatialMatrix inertia;
+        Vector6 force;
+        if (dof == 1)
+        {
+            Vector6 u = projected_inertia.col(0);
+            inertia = articulated_inertias[i] - u * (inverse_joint_inertia(0, 0) * u.transpose());
+            force = bias_forces[i] + inertia * bias_accelerations[i] + u * (inverse_joint_inertia(0, 0) * projected_force[0]);
+        }
+        else
+        {
+            inertia = articulated_inertias[i] - projected_inertia * inverse_joint_inertia * projected_inertia.transpose();
+            force = bias_forces[i] + inertia * bias_accelerations[i] + projected_inertia * (inverse_joint_inertia * projected_force);
+        }
+
+        articulated_inertias[parent] += parent_transforms[i].transformInertia(inertia);
+        bias_forces[parent] += parent_transforms[i].applyTranspose(force);
+    }
+
+    // Pass 3 (root to leaves): joint and link accelerations
+    Vector6 root_acceleration = getRootAcceleration();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t dof = GetJointDoF(joint_types[i]);
+        const Vector6& parent_acceleration = parents[i] < 0 ? root_acceleration : link_accelerations[parents[i]];
+
+        Vector6 acceleration = parent_transforms[i].apply(parent_acceleration) + bias_accelerations[i];
+        Vector3 joint_acceleration = inverse_joint_inertias[i] * (projected_forces[i] - projected_inertias[i].transpose() * acceleration);
+        for (uint32_t j = dof; j < 3; j++) joint_acceleration[j] = 0.0;
+
+        WriteJointVector(accelerations, velocity_offsets[i], dof, joint_acceleration);
+        link_accelerations[i] = acceleration + motion_subspaces[i] * joint_acceleration;
+    }
+}
+
+void KinematicTree::calculateInverseDynamics(const VectorX& desired_accelerations, VectorX& result)
+{
+    PHYSICS_TRACE_SCOPE("KinematicTree::calculateInverseDynamics");
+    calculateJointTransforms();
+    uint32_t count = static_cast<uint32_t>(parents.size());
+    result.resize(velocities.size());
+
+    // Forward pass: velocity and acceleration of every link, then the force each one needs to move like that
+    Vector6 root_acceleration = getRootAcceleration();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t dof = GetJointDoF(joint_types[i]);
+        const Eigen::Matrix<Real, 6, 3>& subspace = motion_subspaces[i];
+        Vector6 joint_velocity = subspace * ReadJointVector(velocities, velocity_offsets[i], dof);
+        Vector6 joint_acceleration = subspace * ReadJointVector(desired_accelerations, velocity_offsets[i], dof);
+
+        Vector6 velocity = joint_velocity;
+        Vector6 acceleration = joint_acceleration + parent_transforms[i].apply(parents[i] < 0 ? root_acceleration : link_accelerations[parents[i]]);
+        if (parents[i] >= 0) velocity += parent_transforms[i].apply(link_velocities[parents[i]]);
+        acceleration += MotionCross(velocity, joint_velocity);
+
+        link_velocities[i] = velocity;
+        link_accelerations[i] = acceleration;
+        bias_forces[i] = inertias[i] * acceleration + ForceCross(velocity, inertias[i] * velocity);
+    }
+
+    // Backward pass: project each link's force onto its joint and pass the rest to the parent
+    for (int32_t i = static_cast<int32_t>(count) - 1; i >= 0; i--)
+    {
+        WriteJointVector(result, velocity_offsets[i], GetJointDoF(joint_types[i]), motion_subspaces[i].transpose() * bias_forces[i]);
+        if (parents[i] >= 0) bias_forces[parents[i]] += parent_transforms[i].applyTranspose(bias_forces[i]);
+    }
+}
+
+void KinematicTree::step(Real delta)
+{
+    PHYSICS_TRACE_SCOPE("KinematicTree::step");
+    calculateForwardDynamics();
+    velocities += accelerations * delta;
+
+    for (uint32_t i = 0; i < parents.size(); i++)
+    {
+        uint32_t q = position_offsets[i];
+        uint32_t v = velocity_offsets[i];
+        if (joint_types[i] != TreeJointType::SPHERICAL)
+        {
+            positions[q] += velocities[v] * delta;
+            continue;
+        }
+
+        // The angular velocity is in the link frame so the delta rotation goes on the right
+        Vector3 omega = velocities.segment<3>(v);
+        Real omega_magnitude = omega.norm();
+        if (omega_magnitude == 0.0) continue;
+
+        Quaternion delta_q = Quaternion(cos(omega_magnitude * delta / 2.0), 0.0, 0.0, 0.0);
+        delta_q.vec() = omega / omega_magnitude * sin(omega_magnitude * delta / 2.0);
+
+        Quaternion orientation = Quaternion(positions[q + 3], positions[q], positions[q + 1], positions[q + 2]) * delta_q;
+        positions.segment<4>(q) = orientation.normalized().coeffs();
+    }
+
+    calculateJointTransforms();
+}
+
+Matrix4 KinematicTree::getWorldMatrix(int32_t link) const
+{
+    if (link < 0 || link >= static_cast<int32_t>(link_transforms.size())) return {};
+
+    Affine3 mat = Affine3::Identity();
+    mat.translate(link_transforms[link].position);
+    mat.rotate(link_transforms[link].orientation);
+    return mat.matrix();
+}
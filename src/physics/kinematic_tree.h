@@ -0,0 +1,92 @@
+#pragma once
+#include "physics.h"
+
+/*
+    Articulated bodies in reduced (joint) coordinates.
+    Links are stored in topological order (a link's parent always comes before it) in flat arrays, so every pass over the tree is a
+    single forward or backward loop: Featherstone's articulated-body algorithm for forward dynamics and RNEA for inverse dynamics, both O(n).
+    Joints can't drift apart so there's no constraint solving, a chain of any length steps in one pass.
+
+    Spatial vectors follow dynamics.h: angular part first, then linear, expressed in each link's frame (origin at its joint).
+*/
+
+using VectorX = Eigen::Matrix<Real, Eigen::Dynamic, 1>;
+
+enum TreeJointType : uint8_t
+{
+    REVOLUTE,   // 1 DoF rotation about the axis
+    PRISMATIC,  // 1 DoF translation along the axis
+    SPHERICAL   // 3 DoF rotation, position is a quaternion (x y z w), velocity is the angular velocity in the link frame
+};
+
+class KinematicTree
+{
+    private:
+        // Per link, in topological order
+        std::vector<int32_t> parents;
+        std::vector<TreeJointType> joint_types;
+        std::vector<Vector3> joint_axes;
+        std::vector<Transform> joint_frames;     // Joint frame relative to the parent link (or the base for roots)
+        std::vector<SpatialInertia> inertias;    // Centre of mass relative to the joint, in the link frame
+        std::vector<uint32_t> position_offsets;
+        std::vector<uint32_t> velocity_offsets;
+
+        VectorX positions;
+        VectorX velocities;
+        VectorX accelerations;
+        VectorX torques;
+
+        Transform base;
+        Vector6 grav_acceleration = Vector6::Zero();
+
+        // Scratch for the passes, sized when links are added so stepping doesn't allocate
+        std::vector<SpatialTransform> parent_transforms;  // From the parent frame to the link frame
+        std::vector<Vector6> link_velocities;
+        std::vector<Vector6> link_accelerations;
+        std::vector<Vector6> bias_accelerations;
+        std::vector<Vector6> bias_forces;
+        std::vector<SpatialMatrix> articulated_inertias;
+        std::vector<Eigen::Matrix<Real, 6, 3>> motion_subspaces;
+        std::vector<Eigen::Matrix<Real, 6, 3>> projected_inertias;
+        std::vector<Matrix3> inverse_joint_inertias;
+        std::vector<Vector3> projected_forces;
+
+        std::vector<Transform> link_transforms;
+
+        void calculateJointTransforms();
+        Vector6 getRootAcceleration() const;
+
+    public:
+        KinematicTree() {}
+
+        // parent is -1 for a root. The link frame starts at joint_frame (relative to the parent link) and moves with the joint
+        // The shape is centred on center_of_mass in the link frame
+        int32_t addLink(int32_t parent, TreeJointType type, const Vector3& axis, const Transform& joint_frame, const PhysicsShape& shape, Real mass, const Vector3& center_of_mass = Vector3::Zero());
+
+        uint32_t getLinkCount() const { return static_cast<uint32_t>(parents.size()); }
+        uint32_t getPositionOffset(int32_t link) const { return position_offsets[link]; }
+        uint32_t getVelocityOffset(int32_t link) const { return velocity_offsets[link]; }
+
+        // Generalised coordinates for every joint, indexed with the offsets above
+        const VectorX& getJointPositions() const { return positions; }
+        const VectorX& getJointVelocities() const { return velocities; }
+        const VectorX& getJointAccelerations() const { return accelerations; }
+        void setJointPositions(const VectorX& q);
+        void setJointVelocities(const VectorX& qd);
+        void setJointTorques(const VectorX& tau);
+
+        void setBaseTransform(const Transform& transform);
+        void setGravity(const Vector6& grav);
+
+        // Articulated-body algorithm: joint accelerations from the current positions, velocities, torques and gravity
+        void calculateForwardDynamics();
+
+        // RNEA: joint torques needed to get the desired joint accelerations at the current positions and velocities
+        void calculateInverseDynamics(const VectorX& desired_accelerations, VectorX& result);
+
+        // Forward dynamics then semi-implicit Euler on the joint coordinates
+        void step(Real delta);
+
+        const Transform& getLinkTransform(int32_t link) const { return link_transforms[link]; }
+        Matrix4 getWorldMatrix(int32_t link) const;
+};
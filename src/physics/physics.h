@@ -1,32 +1,13 @@
 #pragma once
 #include <vector>
-#include <deque>
 #include <memory>
 #include <Eigen/Dense>
 #include <cmath>
+#include "precision.h"
+#include "spatial.h"
+#include "step_profiler.h"
+#include "frame_arena.h"
 
-#define PRECISION_HIGH
-
-#ifdef PRECISION_HIGH
-    using Real = double;
-    using Vector3 = Eigen::Vector3d;
-    using Quaternion = Eigen::Quaterniond;
-    using Matrix4 = Eigen::Matrix4d;
-    using Matrix3 = Eigen::Matrix3d;
-    using Affine3 = Eigen::Affine3d;
-    using Vector2 = Eigen::Vector2d;
-#else
-    using Real = float;
-    using Vector3 = Eigen::Vector3f;
-    using Quaternion = Eigen::Quaternionf;
-    using Matrix4 = Eigen::Matrix4f;
-    using Matrix3 = Eigen::Matrix3f;
-    using Affine3 = Eigen::Affine3f;
-    using Vector2 = Eigen::Vector2f;
-#endif
-
-using Vector6 = Eigen::Matrix<Real, 6, 1>;
-using BodyID = int32_t;
 
 
 inline Real DegreesToRadians(Real degrees)
@@ -59,12 +40,24 @@ enum ShapeType
     SPHERE,
     PLANE,
     OBB,
+    MESH,
+    HEIGHTFIELD,
     NUM_SHAPES
 };
 
 struct PhysicsMaterial
 {
     Real restitution = 1.0f;
+
+    // Coulomb friction coefficient (a contact uses the smaller of the two bodies')
+    Real friction = 0.5;
+
+    // Anisotropic friction: sliding along friction_axis (body space, zero for none) uses axis_friction instead, e.g. skates or grooved metal
+    Vector3 friction_axis = Vector3::Zero();
+    Real axis_friction = 0.0;
+
+    // Rolling friction: the contact can resist rolling with up to rolling_friction * normal force of torque (so it's a length). 0 rolls forever
+    Real rolling_friction = 0.0;
 };
 
 struct SphereShape
@@ -82,6 +75,23 @@ struct OBBShape
     Vector3 half_extent;
 };
 
+class TriangleMesh;
+
+// The mesh is owned by the caller and has to outlive every body using it
+struct MeshShape
+{
+    const TriangleMesh* mesh;
+};
+
+class HeightField;
+class SplinePath;
+
+// Same ownership rules as MeshShape
+struct HeightFieldShape
+{
+    const HeightField* field;
+};
+
 struct PhysicsShape
 {
     ShapeType type;
@@ -91,11 +101,15 @@ struct PhysicsShape
         SphereShape sphere;
         PlaneShape plane;
         OBBShape obb;
+        MeshShape mesh;
+        HeightFieldShape heightfield;
     };
 
     static PhysicsShape MakeSphere(Real radius);
     static PhysicsShape MakePlane(const Vector2& extent);
     static PhysicsShape MakeOBB(const Vector3& half_extent);
+    static PhysicsShape MakeMesh(const TriangleMesh* mesh);
+    static PhysicsShape MakeHeightField(const HeightField* field);
 };
 
 Eigen::Matrix<Real, 6, 6> GetSpatialInertia(const PhysicsShape& shape, Real mass);
@@ -120,7 +134,7 @@ class PhysicsBody
     private:
         Real mass = 0.0;
         PhysicsShape shape;
-        Eigen::Matrix<Real, 6, 6> spatial_inertia = Eigen::Matrix<Real, 6, 6>::Identity();
+        SpatialInertia spatial_inertia;
         Matrix3 inverse_inertia = Matrix3::Identity();
         Vector6 velocity = Vector6::Zero();
         Transform transform;
@@ -129,9 +143,19 @@ class PhysicsBody
         Vector3 force = Vector3::Zero();
         Vector3 torque = Vector3::Zero();
 
+        // Linear correction applied by the position solver this step (used to keep contact depths up to date between iterations)
+        Vector3 position_correction = Vector3::Zero();
+
         PhysicsLayer layer = PhysicsLayer::STATIC;
         PhysicsMaterial material;
 
+        // Opt in to continuous collision so fast bodies can't tunnel through thin geometry
+        bool continuous = false;
+
+        // Kinematic bodies can follow a path (owned by the caller), path_time is how far along it they are
+        const SplinePath* path = nullptr;
+        Real path_time = 0.0;
+
         friend class PhysicsWorld;
 
         PhysicsBody(const PhysicsShape& shape, const PhysicsMaterial& material, const Vector3& position, const Quaternion& orientation, Real mass, PhysicsLayer layer);
@@ -141,12 +165,24 @@ class PhysicsBody
 };
 
 
+constexpr uint32_t MAX_CONTACT_POINTS = 4;
+
+struct ContactPoint
+{
+    Vector3 point = Vector3::Zero();
+    Real depth = 0.0;
+};
+
 struct CollisionQuery
 {
     bool colliding = false;
     Vector3 norm = Vector3::Identity();
     Real depth = 0.0;
     Vector3 point = Vector3::Zero();
+
+    // Shapes that touch over an area (e.g. a box resting on a plane) fill in a manifold. When there is one, the solver uses it instead of point / depth
+    uint32_t contact_count = 0;
+    ContactPoint contacts[MAX_CONTACT_POINTS];
 };
 
 struct Collision
@@ -157,18 +193,196 @@ struct Collision
     Real depth = 0.0;
     Vector3 point = Vector3::Zero();
     Real accumulated_impulse = 0.0;
+    Real bounce_velocity = 0.0;
+
+    // Filled in once per step by prepareCollisionVelocities so the iterations don't redo them (everything is in world space)
+    Vector3 radius_a = Vector3::Zero();
+    Vector3 radius_b = Vector3::Zero();
+    Real normal_mass = 0.0;
+
+    // The contact point in each body's space, sub-stepping uses them to track the depth as the bodies move during the step
+    Vector3 local_point_a = Vector3::Zero();
+    Vector3 local_point_b = Vector3::Zero();
+
+    // Friction rows along the two tangents (the first one is along the sliding direction or the anisotropic axis) and rolling rows about them
+    Vector3 tangents[2] = { Vector3::Zero(), Vector3::Zero() };
+    Real tangent_masses[2] = {};
+    Real rolling_masses[2] = {};
+    Real friction[2] = {};
+    Real rolling_friction = 0.0;
+    Real accumulated_friction[2] = {};
+    Real accumulated_rolling[2] = {};
+};
+
+// A contact's impulses from the last step, kept by sub-stepping to warm start the next one. Matched by body pair and index in the pair's manifold
+// Friction and rolling impulses are kept as world space vectors since the tangents change from step to step
+struct CachedContact
+{
+    BodyID a = -1;
+    BodyID b = -1;
+    uint32_t index = 0;
+    Vector3 norm = Vector3::Zero();
+    Real normal_impulse = 0.0;
+    Vector3 friction_impulse = Vector3::Zero();
+    Vector3 rolling_impulse = Vector3::Zero();
+};
+
+// Soft constraint coefficients for a spring of some stiffness (hertz) and damping ratio over a time step (Box2D v3 style)
+// The solver scales the effective mass by mass_scale and bleeds off impulse_scale of the accumulated impulse, the bias is bias_rate * error
+struct SoftConstraint
+{
+    Real bias_rate = 0.0;
+    Real mass_scale = 1.0;
+    Real impulse_scale = 0.0;
+
+    static SoftConstraint Make(Real hertz, Real damping_ratio, Real h);
+};
+
+typedef int32_t JointID;
+
+enum JointType : uint8_t
+{
+    BALL_SOCKET,  // Anchors held together, free rotation
+    HINGE,        // Anchors held together, rotation only about the hinge axis
+    FIXED,        // No relative motion at all
+    DISTANCE      // Anchors held a fixed distance apart (a massless rod, free rotation at both ends)
+};
+
+constexpr uint32_t MAX_JOINT_ROWS = 6;
+
+// One scalar constraint on the pair's world space (solver body) velocities: jacobian_a . v_a + jacobian_b . v_b + bias = 0
+// The response is M^-1 J^T (the change in velocity per unit impulse) so the solver loop doesn't need the inertias
+struct JointRow
+{
+    Vector6 jacobian_a = Vector6::Zero();
+    Vector6 jacobian_b = Vector6::Zero();
+    Vector6 response_a = Vector6::Zero();
+    Vector6 response_b = Vector6::Zero();
+    Real bias = 0.0;
+};
+
+struct PhysicsJoint
+{
+    JointType type = JointType::BALL_SOCKET;
+    BodyID a = -1;
+    BodyID b = -1;
+
+    // In each body's space
+    Vector3 anchor_a = Vector3::Zero();
+    Vector3 anchor_b = Vector3::Zero();
+    Vector3 axis_a = Vector3::UnitX();
+    Vector3 axis_b = Vector3::UnitX();
+
+    // Orientation of b relative to a when the joint was made (fixed joints hold it)
+    Quaternion rest_orientation = Quaternion::Identity();
+    Real distance = 0.0;
+
+    // Rebuilt at the start of every step, the impulses are kept between steps to warm start the next one
+    uint32_t row_count = 0;
+    JointRow rows[MAX_JOINT_ROWS];
+    Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS> effective_mass = Eigen::Matrix<Real, MAX_JOINT_ROWS, MAX_JOINT_ROWS>::Zero();
+    Real accumulated_impulses[MAX_JOINT_ROWS] = {};
+};
+
+class TrajectoryRecorder;
+
+// Bodies connected (directly or through other bodies) by contacts or joints. Static and kinematic bodies don't connect anything
+// The island's joints and contacts are a range of island_joints / island_collisions (indices into joints / collisions)
+struct Island
+{
+    uint32_t joint_start = 0;
+    uint32_t joint_count = 0;
+    uint32_t collision_start = 0;
+    uint32_t collision_count = 0;
+};
+
+// A body as the velocity solver sees it: velocity, inverse mass and inverse inertia all in world space, made once per step (solver_bodies,
+// indexed by BodyID) so contacts and joints don't rotate anything in their iterations. Velocities go back to body space once the solve is done
+// Static and kinematic bodies have zero inverse mass and inertia, impulses don't move them
+struct SolverBody
+{
+    Vector6 velocity = Vector6::Zero();  // Angular then linear, like PhysicsBody::velocity
+    Matrix3 inverse_inertia = Matrix3::Zero();
+    Real inverse_mass = 0.0;
+
+    Vector3 getPointVelocity(const Vector3& radius) const
+    {
+        return velocity.tail<3>() + velocity.head<3>().cross(radius);
+    }
+
+    // An impulse at radius from the centre of mass
+    void applyImpulse(const Vector3& impulse, const Vector3& radius)
+    {
+        velocity.head<3>() += inverse_inertia * radius.cross(impulse);
+        velocity.tail<3>() += inverse_mass * impulse;
+    }
+
+    void applyAngularImpulse(const Vector3& impulse)
+    {
+        velocity.head<3>() += inverse_inertia * impulse;
+    }
+};
+
+// How bodies pick up the velocity dependent (gyroscopic) term w x Iw as they spin
+enum Integrator : uint8_t
+{
+    EXPLICIT_EULER,       // Worked out from the velocity at the start of the step. Cheapest, but spinning bodies gain energy as the step grows
+    IMPLICIT_GYROSCOPIC,  // Solved implicitly (one Newton step), stable at any step size, slowly damps spin about the unstable axis
+    SYMPLECTIC_EULER      // Angular momentum is carried over to the new orientation exactly (like the linear velocity), energy doesn't drift either way
+};
+
+struct BodyPair
+{
+    BodyID a = -1;
+    BodyID b = -1;
+};
+
+// Meshes, heightfields and paths a snapshot can refer to. Snapshots store the index into these tables instead of the pointer, so a blob
+// can be restored in another process as long as the tables list the same objects in the same order (e.g. built from the asset list)
+struct SnapshotResources
+{
+    std::vector<const TriangleMesh*> meshes;
+    std::vector<const HeightField*> heightfields;
+    std::vector<const SplinePath*> paths;
 };
 
 class PhysicsWorld
 {
+    // Lets the microbenchmarks call the collision kernels and solver directly
+    friend struct PhysicsBenchAccess;
+
     private:
         std::vector<PhysicsBody> bodies;
         Vector6 grav_acceleration = Vector6::Zero();
 
-        std::deque<Collision> collisions;
-
-        // For all plane collision algorithms, they just assume the plane is infinite for now
-        // Time permitting: take into account plane extents
+        // Everything that only lives for one step comes out of the frame arena (reset at the end of update)
+        FrameArena frame_arena;
+        const size_t frameBytesPerBody = 2048;  // Roughly a body's bounds, pairs, a few contacts and its solver body
+        FrameArray<BodyPair> pairs;
+        FrameArray<Collision> collisions;
+        FrameArray<Island> islands;
+        FrameArray<uint32_t> island_joints;
+        FrameArray<uint32_t> island_collisions;
+        FrameArray<SolverBody> solver_bodies;
+
+        StepProfiler profiler;
+        AllocationCounter allocation_counter = nullptr;
+
+        TrajectoryRecorder* recorder = nullptr;
+        Real recording_time = 0.0;
+
+        // Rollback ring (rollback.cpp): one slot per frame holding the transforms and velocities of the non static bodies
+        std::vector<BodyID> rollback_bodies;
+        std::vector<Real> rollback_states;
+        std::vector<int64_t> rollback_frames;
+        uint32_t rollback_capacity = 0;
+        uint32_t rollback_joint_count = 0;
+        std::vector<std::vector<CachedContact>> rollback_contacts;
+        bool isRollbackBodySetCurrent() const;
+
+        // Joints (joints.cpp) and the body pairs they connect as sorted (a, b) keys, so the broadphase can skip jointed pairs
+        std::vector<PhysicsJoint> joints;
+        std::vector<uint64_t> joint_pairs;
 
         static CollisionQuery checkSphereSphereCollision(const PhysicsShape* const a, const Transform* const at, const PhysicsShape* const b, const Transform* const bt);
         static CollisionQuery checkSpherePlaneCollision(const PhysicsShape* const sphere, const Transform* sphere_transform, const PhysicsShape* const plane, const Transform* const plane_transform);
@@ -184,21 +398,83 @@ class PhysicsWorld
         static CollisionQuery checkBoxOBBCollision(const PhysicsShape* const box, const Transform* const box_transform, const PhysicsShape* const obb, const Transform* const obb_transform);
         static CollisionQuery checkOBBOBBCollision(const PhysicsShape* const a, const Transform* const a_transform, const PhysicsShape* const b, const Transform* const b_transform);
 
+        static CollisionQuery checkSphereMeshCollision(const PhysicsShape* const sphere, const Transform* const sphere_transform, const PhysicsShape* const mesh, const Transform* const mesh_transform);
+        static CollisionQuery checkOBBMeshCollision(const PhysicsShape* const obb, const Transform* const obb_transform, const PhysicsShape* const mesh, const Transform* const mesh_transform);
+
+        static CollisionQuery checkSphereHeightFieldCollision(const PhysicsShape* const sphere, const Transform* const sphere_transform, const PhysicsShape* const heightfield, const Transform* const heightfield_transform);
+        static CollisionQuery checkOBBHeightFieldCollision(const PhysicsShape* const obb, const Transform* const obb_transform, const PhysicsShape* const heightfield, const Transform* const heightfield_transform);
+
+        // Iteration limits, each island stops early once an iteration changes velocities / leaves penetration by less than the tolerance
         const uint32_t collisionPositionIterations = 10;
         const uint32_t collisionVelocityIterations = 10;
+        Real velocity_tolerance = 1e-3;
+        Real penetration_tolerance = 1e-3;
+
+        // broadphase.cpp: fills pairs with the bodies whose bounds overlap
+        void findPairs(Real delta);
+
+        // islands.cpp
+        void buildIslands();
+        uint32_t solveIslandVelocities(const Island& island, Real delta);
+        uint32_t solveIslandPositions(const Island& island);
 
         CollisionQuery checkCollision(const PhysicsBody* a, const PhysicsBody* b);
-        void handleCollisionVelocities(Collision& collision, Real delta);
-        void handleCollisionPositions(const Collision& collision);
+        CollisionQuery checkCollision(const PhysicsShape* a, const Transform* a_transform, const PhysicsShape* b, const Transform* b_transform);
+
+        // Speculative contacts: pairs within a velocity expanded margin get a contact with a negative depth (the gap) so the solver can stop them at the surface
+        bool speculative_contacts = false;
+        bool deterministic = false;
+        const uint32_t speculativeMaxSamples = 8;
+        CollisionQuery checkSpeculativeCollision(const PhysicsBody* a, const PhysicsBody* b, Real delta);
+        void prepareCollisionVelocities(Collision& collision);
+        // Both return a residual for the early out: the largest velocity change the pass made / the penetration (past the slop) it started from
+        Real handleCollisionVelocities(Collision& collision, Real delta);
+        Real handleCollisionPositions(const Collision& collision);
+
+        Integrator integrator = Integrator::EXPLICIT_EULER;
+        const uint32_t symplecticMaxIterations = 16;
+        void integrateVelocities(Real delta);
+        void integratePositions(Real delta);
+
+        // Fills solver_bodies from the current transforms and velocities. Sub-steps reload / store the velocities around each integration
+        void prepareSolverBodies();
+        void loadSolverVelocities();
+        void storeSolverVelocities();
+
+        // Sub-stepping (substeps.cpp): 1 keeps the usual velocity iterations followed by position projection
+        uint32_t substep_count = 1;
+        const Real substepContactHertz = 30.0;
+        const Real substepContactDampingRatio = 10.0;
+        const Real substepMaxPushVelocity = 3.0;
+        std::vector<CachedContact> contact_cache;  // Sorted by (a, b, index)
+        void solveSubsteps(Real delta);
+        void loadCachedImpulses();
+        void storeCachedImpulses();
+        void warmStartCollision(const Collision& collision);
+        void handleSoftCollisionVelocities(Collision& collision, Real inverse_h, const SoftConstraint& soft, bool use_bias);
+        void applyRestitution(Collision& collision);
+
+        JointID addJoint(const PhysicsJoint& joint);
+        void rebuildJointPairs();
+        bool isJointed(BodyID a, BodyID b) const;
+        void prepareJoint(PhysicsJoint& joint, Real delta);
+        Real handleJointVelocities(PhysicsJoint& joint, bool use_bias = true);
+
+        // Continuous collision: fraction of this step's motion a body can move before it hits something
+        const uint32_t continuousMaxIterations = 32;
+        Real computeTimeOfImpact(BodyID id, Real delta);
+        static Real getDistance(const Vector3& point, const PhysicsBody& body, Real max_distance);
 
         // Array of func pointers for collision tests
         typedef CollisionQuery (*CollisionFunc)(const PhysicsShape* const, const Transform* const, const PhysicsShape* const, const Transform* const);
         CollisionFunc collision_funcs[ShapeType::NUM_SHAPES][ShapeType::NUM_SHAPES] = 
         {
-            {nullptr, nullptr, nullptr, nullptr},
-            {nullptr, checkSphereSphereCollision, checkSpherePlaneCollision, checkSphereOBBCollision},
-            {nullptr, nullptr /*plane sphere*/, checkPlanePlaneCollision, checkPlaneOBBCollision},
-            {nullptr, nullptr, nullptr, checkOBBOBBCollision}
+            {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+            {nullptr, checkSphereSphereCollision, checkSpherePlaneCollision, checkSphereOBBCollision, checkSphereMeshCollision, checkSphereHeightFieldCollision},
+            {nullptr, nullptr /*plane sphere*/, checkPlanePlaneCollision, checkPlaneOBBCollision, nullptr, nullptr},
+            {nullptr, nullptr, nullptr, checkOBBOBBCollision, checkOBBMeshCollision, checkOBBHeightFieldCollision},
+            {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+            {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}
         };
 
     public:
@@ -214,13 +490,73 @@ class PhysicsWorld
         // Body manipulation functions
         void setLinearVelocity(BodyID id, const Vector3& v);
         void setAngularVelocity(BodyID id, const Vector3& omega);
+        void setContinuousCollision(BodyID id, bool enabled);
+
+        // Moves a kinematic body along the path starting time seconds in (nullptr leaves it where it is). The path has to outlive the body
+        // Every step the body's velocity is the path's, so contacts see it moving, and it's put back exactly on the path at the end
+        void setKinematicPath(BodyID id, const SplinePath* path, Real time = 0.0);
         
         Matrix4 getWorldMatrix(BodyID id);
+        Transform getTransform(BodyID id) const;
+        uint32_t getBodyCount() const;
 
         // This should be outside of this class but for now it's ok
         bool isColliding(BodyID a, BodyID b);
 
+        // Joints are made from the bodies' current transforms, anchors and axes are given in world space. Returns -1 if the bodies aren't valid
+        // Bodies connected by a joint don't collide with each other. To pin a body to the world, join it to a static body
+        JointID createBallJoint(BodyID a, BodyID b, const Vector3& anchor);
+        JointID createHingeJoint(BodyID a, BodyID b, const Vector3& anchor, const Vector3& axis);
+        JointID createFixedJoint(BodyID a, BodyID b);
+        JointID createDistanceJoint(BodyID a, BodyID b, const Vector3& anchor_a, const Vector3& anchor_b);
+        uint32_t getJointCount() const;
+
         void setGravity(const Vector6& grav);
+        void setSpeculativeContacts(bool enabled);
+
+        // Deterministic mode: the broadphase pairs are sorted into a canonical (a < b, by id) order before the narrowphase so contacts are always solved in the same order
+        // For bit identical results across machines physics_lib also has to be built with PHYSICS_DETERMINISTIC (no FP contraction / fast math)
+        void setDeterministic(bool enabled);
+
+        // Splits every step into count sub-steps, each integrating, solving once with soft contacts and then relaxing once without the push
+        // out (temporal Gauss-Seidel). Collision detection still runs once per step and there's no separate position pass
+        // Usually stacks better than the default solver at the same cost, 4 is a good start. 1 goes back to the default solver
+        void setSubsteps(uint32_t count);
+
+        // Each island's velocity / position iterations stop once the largest velocity change in an iteration (m/s or rad/s) / the deepest
+        // penetration past the slop (m) is under these. 0 always runs the full 10 iterations. Sub-stepping ignores them
+        void setSolverTolerance(Real velocity, Real penetration);
+
+        // Picks how spinning bodies are integrated (see Integrator). The default explicit scheme needs small steps for fast spinning bodies,
+        // the other two stay stable at much bigger ones
+        void setIntegrator(Integrator integrator);
+
+        // 64 bit FNV-1a hash of every body's position, orientation and velocity bits (and the sub-stepping contact cache). Two runs match if their hashes match after every step
+        uint64_t getStateHash() const;
+
+        // Timings and counters for the last step plus the average / peak over a rolling window of recent steps
+        StepStats getStepStats() const;
+        void setProfiling(bool enabled);
+
+        // Saves / restores the whole world state in a versioned binary blob (layout in snapshot.cpp). Restore returns false and leaves the world alone if the blob doesn't match
+        // Mesh, heightfield and path data isn't copied, they're saved as indices into resources. Save fails if a body uses one that isn't in
+        // the tables, restore fails if the blob refers to one the given tables don't have
+        bool saveSnapshot(std::vector<uint8_t>& blob, const SnapshotResources* resources = nullptr) const;
+        bool restoreSnapshot(const std::vector<uint8_t>& blob, const SnapshotResources* resources = nullptr);
+        bool restoreSnapshot(const uint8_t* data, size_t size, const SnapshotResources* resources = nullptr);
+
+        // Keeps the dynamic state of the last `frames` saved frames in memory so rollback netcode can rewind and resimulate
+        // Only positions, orientations and velocities of dynamic / kinematic bodies (and joint warm start impulses) are stored, so save and restore are a copy per body
+        // Creating bodies or joints after the ring is set up, or restoring a snapshot, invalidates the saved frames
+        void setRollbackCapacity(uint32_t frames);
+        void saveRollbackFrame(uint32_t frame);
+        bool rollbackToFrame(uint32_t frame);
+
+        // Appends a frame to the recorder at the end of every update (nullptr stops recording). The recorder is owned by the caller
+        void setRecorder(TrajectoryRecorder* recorder);
+
+        // Lets the step stats report heap allocations made during update (the counter has to come from the app, e.g. a replaced operator new)
+        void setAllocationCounter(AllocationCounter counter);
 
         // void set_time_step(Real duration);
 
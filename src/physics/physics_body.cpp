@@ -3,6 +3,6 @@
 PhysicsBody::PhysicsBody(const PhysicsShape& shape, const PhysicsMaterial& material, const Vector3& position, const Quaternion& orientation, Real mass, PhysicsLayer layer)
 :shape(shape), material(material), transform(position, orientation), mass(mass), layer(layer)
 {
-    spatial_inertia = GetSpatialInertia(shape, mass);
+    spatial_inertia = SpatialInertia::FromMatrix(GetSpatialInertia(shape, mass));
     inverse_inertia = GetInertiaTensor(shape, mass).inverse();
 }
\ No newline at end of file
@@ -1,5 +1,4 @@
 #include "physics.h"
-#include <iostream>
 
 static Eigen::Matrix<Real, 6, 6> GetSphereSpatialInertia(const SphereShape& sphere, Real mass)
 {
@@ -65,9 +64,9 @@ static Matrix3 GetSphereInertiaTensor(const SphereShape& sphere, Real mass)
     return inertia_tensor;
 }
 
+// Planes are only ever static so they never rotate, same placeholder as GetPlaneSpatialInertia
 static Matrix3 GetPlaneInertiaTensor(const PlaneShape& plane, Real mass)
 {
-    std::cout << "Plane Inertia Tensor Not Implemented: " << __FILE__ << ":" << __LINE__ << std::endl;
     return Matrix3::Identity();
 }
 
@@ -129,4 +128,24 @@ PhysicsShape PhysicsShape::MakeOBB(const Vector3& half_extent)
             .half_extent = half_extent
         }
     };
+}
+
+PhysicsShape PhysicsShape::MakeMesh(const TriangleMesh* mesh)
+{
+    return PhysicsShape{
+        .type = ShapeType::MESH,
+        .mesh = MeshShape{
+            .mesh = mesh
+        }
+    };
+}
+
+PhysicsShape PhysicsShape::MakeHeightField(const HeightField* field)
+{
+    return PhysicsShape{
+        .type = ShapeType::HEIGHTFIELD,
+        .heightfield = HeightFieldShape{
+            .field = field
+        }
+    };
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "physics.h"
 #include "dynamics.h"
+#include "spline_path.h"
+#include "trace.h"
+#include "trajectory.h"
+#include <algorithm>
 #include <iostream>
 
 static Matrix4 get_transform_matrix(const Transform& transform)
@@ -12,12 +16,14 @@ static Matrix4 get_transform_matrix(const Transform& transform)
 
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, PhysicsMaterial{}, Vector3::Zero(), Quaternion::Identity(), mass, layer));
     return id;
 }
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const Vector3& position, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, PhysicsMaterial{}, position, Quaternion::Identity(), mass, layer));
     return id;
@@ -25,6 +31,7 @@ BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const Vector3& positi
 
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const Vector3& position, const Quaternion& orientation, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, PhysicsMaterial{}, position, orientation, mass, layer));
     return id;
@@ -32,6 +39,7 @@ BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const Vector3& positi
 
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const PhysicsMaterial& material, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, material, Vector3::Zero(), Quaternion::Identity(), mass, layer));
     return id;
@@ -39,6 +47,7 @@ BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const PhysicsMaterial
 
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const PhysicsMaterial& material, const Vector3& position, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, material, position, Quaternion::Identity(), mass, layer));
     return id;
@@ -46,6 +55,7 @@ BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const PhysicsMaterial
 
 BodyID PhysicsWorld::createBody(const PhysicsShape& shape, const PhysicsMaterial& material, const Vector3& position, const Quaternion& orientation, Real mass, PhysicsLayer layer)
 {
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::createBody");
     BodyID id = bodies.size();
     bodies.push_back(PhysicsBody(shape, material, position, orientation, mass, layer));
     return id;
@@ -59,6 +69,18 @@ Matrix4 PhysicsWorld::getWorldMatrix(BodyID id)
     return get_transform_matrix(body.transform);
 }
 
+Transform PhysicsWorld::getTransform(BodyID id) const
+{
+    if (id < 0 || id > bodies.size() - 1) return {};
+
+    return bodies[id].transform;
+}
+
+uint32_t PhysicsWorld::getBodyCount() const
+{
+    return static_cast<uint32_t>(bodies.size());
+}
+
 void PhysicsWorld::setLinearVelocity(BodyID id, const Vector3& v)
 {
     if (id < 0 || id > bodies.size() - 1) return;
@@ -74,69 +96,314 @@ void PhysicsWorld::setAngularVelocity(BodyID id, const Vector3& omega)
     PhysicsBody& body = bodies[id];
     body.velocity.segment<3>(0) = body.transform.orientation.inverse() * omega;
 }
-       
 
-// TODO: Make it so update runs multiple steps if delta > 1 / 60
-void PhysicsWorld::update(Real delta)
+void PhysicsWorld::setContinuousCollision(BodyID id, bool enabled)
+{
+    if (id < 0 || id > bodies.size() - 1) return;
+
+    bodies[id].continuous = enabled;
+}
+
+void PhysicsWorld::setKinematicPath(BodyID id, const SplinePath* path, Real time)
+{
+    if (id < 0 || id > bodies.size() - 1) return;
+
+    PhysicsBody& body = bodies[id];
+    if (body.layer != PhysicsLayer::KINEMATIC) return;
+
+    body.path = path;
+    body.path_time = time;
+    if (path)
+    {
+        body.transform.position = path->getPosition(time);
+    }
+}
+
+// Rotation by omega (world space) over time
+static Quaternion GetRotation(const Vector3& omega, Real time)
+{
+    Real omega_magnitude = omega.norm();
+    return Quaternion(cos(omega_magnitude * time / 2.0), omega.normalized() * sin(omega_magnitude * time / 2.0));
+}
+
+void PhysicsWorld::integrateVelocities(Real delta)
 {
-    // Integrate Velocities
     for (PhysicsBody& body : bodies)
     {
         if (body.layer == PhysicsLayer::DYNAMIC)
         {
-            Vector6 acceleration = calculateForwardDynamics({ .velocity = body.velocity, .spatial_inertia = body.spatial_inertia }, grav_acceleration * body.mass);
-            body.velocity += acceleration * delta;
+            // Gravity is given in world space but the dynamics are done in body space
+            Quaternion inverse_orientation = body.transform.orientation.inverse();
+            Vector6 gravity;
+            gravity << inverse_orientation * getAngularFromSpatial(grav_acceleration), inverse_orientation * getLinearFromSpatial(grav_acceleration);
+
+            // The w x v part of the linear acceleration only tracks the body frame turning under a world fixed velocity. Integrated explicitly it makes
+            // anything that spins and moves speed up (by w^2 dt^2 / 2 every step, enough to blow up a swinging chain) so it's taken back out here and
+            // the linear velocity is carried over to the new orientation exactly in integratePositions instead
+            if (integrator == Integrator::EXPLICIT_EULER)
+            {
+                Vector6 acceleration = calculateForwardDynamics({ .velocity = body.velocity, .spatial_inertia = body.spatial_inertia }, gravity * body.mass);
+                acceleration.segment<3>(3) += getAngularFromSpatial(body.velocity).cross(getLinearFromSpatial(body.velocity));
+                body.velocity += acceleration * delta;
+            }
+            else
+            {
+                // Only the external forces here. The symplectic scheme treats w x Iw the same way as w x v (carried over in integratePositions)
+                if (integrator == Integrator::IMPLICIT_GYROSCOPIC)
+                {
+                    body.velocity.segment<3>(0) = calculateImplicitGyroscopic(body.spatial_inertia.inertia.toMatrix(), getAngularFromSpatial(body.velocity), delta);
+                }
+                body.velocity += body.spatial_inertia.solve(gravity * body.mass) * delta;
+            }
+
+            // Stop it before the solver can pass the NaN on to whatever it touches
+            if (!body.velocity.allFinite())
+            {
+                body.velocity.setZero();
+                profiler.getCurrent().stopped_bodies++;
+            }
+        }
+        else if (body.path)
+        {
+            // The path's velocity halfway through the step, which matches the step's displacement to O(dt^2)
+            Vector3 position, velocity;
+            body.path->evaluate(body.path_time + 0.5 * delta, position, velocity);
+            body.velocity.segment<3>(3) = body.transform.orientation.inverse() * velocity;
         }
     }
+}
 
-    // Collision Queries
+void PhysicsWorld::integratePositions(Real delta)
+{
     for (int i = 0; i < bodies.size(); i++)
     {
-        for (int j = i + 1; j < bodies.size(); j++)
+        PhysicsBody& body = bodies[i];
+        if (body.layer != PhysicsLayer::STATIC)
+        {
+            Transform previous = body.transform;
+            Vector3 linear_velocity = body.transform.orientation * getLinearFromSpatial(body.velocity);
+            if (body.path)
+            {
+                // Snapped to the path rather than integrated so it can't drift off
+                body.path_time += delta;
+                body.transform.position = body.path->getPosition(body.path_time);
+            }
+            else
+            {
+                // Continuous bodies stop at their first time of impact, the discrete contact picks them up next step
+                Real linear_delta = (body.continuous && body.layer == PhysicsLayer::DYNAMIC) ? delta * computeTimeOfImpact(i, delta) : delta;
+                body.transform.position += linear_velocity * linear_delta;
+            }
+
+            Vector3 omega = body.transform.orientation * getAngularFromSpatial(body.velocity);
+
+            // The symplectic scheme keeps the world space angular momentum through the rotation and turns at the angular velocity that momentum
+            // gives halfway through (implicit midpoint, solved by fixed point iteration). Turning at the start of step velocity instead drifts every
+            // tumbling body towards spinning about its smallest axis (the most energy for its momentum)
+            Vector3 momentum = Vector3::Zero();
+            bool keep_momentum = integrator == Integrator::SYMPLECTIC_EULER && body.layer == PhysicsLayer::DYNAMIC;
+            if (keep_momentum)
+            {
+                momentum = body.transform.orientation * (body.spatial_inertia.inertia * getAngularFromSpatial(body.velocity));
+                for (uint32_t k = 0; k < symplecticMaxIterations; k++)
+                {
+                    Quaternion midpoint = GetRotation(omega, 0.5 * delta) * body.transform.orientation;
+                    Vector3 midpoint_omega = midpoint * (body.inverse_inertia * (midpoint.inverse() * momentum));
+                    Real change = (midpoint_omega - omega).squaredNorm();
+                    omega = midpoint_omega;
+                    if (change <= 1e-12 * omega.squaredNorm()) break;
+                }
+            }
+
+            body.transform.orientation = GetRotation(omega, delta) * body.transform.orientation;
+            body.transform.orientation.normalize();
+            body.velocity.segment<3>(3) = body.transform.orientation.inverse() * linear_velocity;
+            if (keep_momentum)
+            {
+                body.velocity.segment<3>(0) = body.inverse_inertia * (body.transform.orientation.inverse() * momentum);
+            }
+
+            // A body that blew up stays where it last was. A NaN transform would overlap everything, and the broadphase would have to leave
+            // it out every step from then on
+            if (!body.velocity.allFinite() || !body.transform.position.allFinite() || !body.transform.orientation.coeffs().allFinite())
+            {
+                body.transform = previous;
+                body.velocity.setZero();
+                profiler.getCurrent().stopped_bodies++;
+            }
+        }
+    }
+}
+
+void PhysicsWorld::prepareSolverBodies()
+{
+    solver_bodies = FrameArray<SolverBody>(frame_arena);
+    solver_bodies.reserve(bodies.size());
+    for (const PhysicsBody& body : bodies)
+    {
+        Matrix3 rotation = body.transform.orientation.toRotationMatrix();
+        SolverBody solver_body;
+        solver_body.velocity << rotation * getAngularFromSpatial(body.velocity), rotation * getLinearFromSpatial(body.velocity);
+        if (body.layer == PhysicsLayer::DYNAMIC)
+        {
+            solver_body.inverse_inertia = rotation * body.inverse_inertia * rotation.transpose();
+            solver_body.inverse_mass = 1.0 / body.mass;
+        }
+        solver_bodies.push_back(solver_body);
+    }
+}
+
+void PhysicsWorld::loadSolverVelocities()
+{
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        const PhysicsBody& body = bodies[i];
+        Matrix3 rotation = body.transform.orientation.toRotationMatrix();
+        solver_bodies[i].velocity << rotation * getAngularFromSpatial(body.velocity), rotation * getLinearFromSpatial(body.velocity);
+    }
+}
+
+// Only dynamic bodies change, rotating the others back and forth would just add rounding error
+void PhysicsWorld::storeSolverVelocities()
+{
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        PhysicsBody& body = bodies[i];
+        if (body.layer != PhysicsLayer::DYNAMIC) continue;
+
+        Matrix3 rotation = body.transform.orientation.toRotationMatrix();
+        body.velocity << rotation.transpose() * getAngularFromSpatial(solver_bodies[i].velocity), rotation.transpose() * getLinearFromSpatial(solver_bodies[i].velocity);
+    }
+}
+
+// TODO: Make it so update runs multiple steps if delta > 1 / 60
+void PhysicsWorld::update(Real delta)
+{
+    PHYSICS_TRACE_SCOPE("PhysicsWorld::update");
+    profiler.beginStep();
+    StepSample& stats = profiler.getCurrent();
+    stats.bodies = static_cast<uint32_t>(bodies.size());
+    uint64_t start_allocations = allocation_counter ? allocation_counter() : 0;
+
+    // The pairs and contacts grow as a scene settles, sizing the arena off the body count means that doesn't keep overflowing it a step at a time
+    frame_arena.reserve(bodies.size() * frameBytesPerBody);
+    collisions = FrameArray<Collision>(frame_arena);
+
+    // Sub-steps integrate inside the solver loop instead
+    bool substepping = substep_count > 1;
+
+    // Integrate Velocities
+    if (!substepping)
+    {
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::INTEGRATE_VELOCITIES);
+        PHYSICS_TRACE_SCOPE("Integrate Velocities");
+        integrateVelocities(delta);
+    }
+
+    // Collision Queries
+    {
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::BROADPHASE);
+        PHYSICS_TRACE_SCOPE("Broadphase");
+        findPairs(delta);
+    }
+
+    {
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::NARROWPHASE);
+        PHYSICS_TRACE_SCOPE("Narrowphase");
+        for (const BodyPair& pair : pairs)
         {
-            if (bodies[i].layer == PhysicsLayer::STATIC && bodies[j].layer == PhysicsLayer::STATIC) continue;
+            CollisionQuery result = checkCollision(&bodies[pair.a], &bodies[pair.b]);
+            if (!result.colliding && speculative_contacts)
+            {
+                result = checkSpeculativeCollision(&bodies[pair.a], &bodies[pair.b], delta);
+                stats.speculative_pairs += result.colliding ? 1 : 0;
+            }
+            if (!result.colliding) continue;
+
+            stats.pairs_colliding++;
+
+            if (result.contact_count == 0)
+            {
+                collisions.push_back(Collision{ .a = pair.a, .b = pair.b, .norm = result.norm, .depth = result.depth, .point = result.point });
+            }
 
-            CollisionQuery result = checkCollision(&bodies[i], &bodies[j]);
-            if (result.colliding) 
+            for (uint32_t k = 0; k < result.contact_count; k++)
             {
-                collisions.push_back(Collision{ .a = i, .b = j, .norm = result.norm, .depth = result.depth, .point = result.point });
+                collisions.push_back(Collision{ .a = pair.a, .b = pair.b, .norm = result.norm, .depth = result.contacts[k].depth, .point = result.contacts[k].point });
             }
         }
+        stats.pairs_tested = pairs.size();
+        stats.contacts = collisions.size();
     }
 
     // Resolve Velocities
-    for (int i = 0; i < collisionVelocityIterations; i++)
+    if (substepping)
     {
+        // The sub-steps do the integration as well, it's all counted as resolving velocities
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::RESOLVE_VELOCITIES);
+        PHYSICS_TRACE_SCOPE("Resolve Substeps");
+        solveSubsteps(delta);
+        stats.velocity_iterations = (collisions.empty() && joints.empty()) ? 0 : 2 * substep_count;
+    }
+    else
+    {
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::RESOLVE_VELOCITIES);
+        PHYSICS_TRACE_SCOPE("Resolve Velocities");
+        prepareSolverBodies();
         for (Collision& collision : collisions)
         {
-            handleCollisionVelocities(collision, delta);
+            prepareCollisionVelocities(collision);
         }
+
+        for (PhysicsJoint& joint : joints)
+        {
+            prepareJoint(joint, delta);
+        }
+
+        buildIslands();
+        stats.islands = islands.size();
+        for (const Island& island : islands)
+        {
+            stats.velocity_iterations = std::max(stats.velocity_iterations, solveIslandVelocities(island, delta));
+        }
+
+        // No islands means no impulses, nothing to rotate back
+        if (!islands.empty()) storeSolverVelocities();
     }
 
     // Integrate Positions
-    for (PhysicsBody& body : bodies)
+    if (!substepping)
     {
-        if (body.layer == PhysicsLayer::DYNAMIC)
-        {
-            body.transform.position += body.transform.orientation * getLinearFromSpatial(body.velocity) * delta;
-            
-            Vector3 omega = body.transform.orientation * getAngularFromSpatial(body.velocity);
-            Real omega_magnitude = omega.norm();
-            Quaternion delta_q = Quaternion(cos(omega_magnitude * delta / 2.0), omega.normalized() * sin(omega_magnitude * delta / 2.0));
-            body.transform.orientation = delta_q * body.transform.orientation;
-            body.transform.orientation.normalize();
-        }
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::INTEGRATE_POSITIONS);
+        PHYSICS_TRACE_SCOPE("Integrate Positions");
+        integratePositions(delta);
     }
 
     // Resolve Positions
-    for (int i = 0; i < collisionPositionIterations; i++)
+    if (!substepping)
     {
-        for (const Collision& collision : collisions)
+        StepProfiler::ScopedTimer timer(profiler, StepPhase::RESOLVE_POSITIONS);
+        PHYSICS_TRACE_SCOPE("Resolve Positions");
+        for (PhysicsBody& body : bodies)
+        {
+            body.position_correction = Vector3::Zero();
+        }
+
+        for (const Island& island : islands)
         {
-            handleCollisionPositions(collision);
+            if (island.collision_count == 0) continue;
+            stats.position_iterations = std::max(stats.position_iterations, solveIslandPositions(island));
         }
     }
-    collisions.clear();
+
+    stats.arena_bytes = static_cast<uint32_t>(frame_arena.getUsed());
+    pairs.release();
+    collisions.release();
+    islands.release();
+    island_joints.release();
+    island_collisions.release();
+    solver_bodies.release();
+    frame_arena.reset();
 
     for (PhysicsBody& body : bodies)
     {
@@ -144,6 +411,16 @@ void PhysicsWorld::update(Real delta)
         body.torque = Vector3::Zero();
     }
 
+    if (recorder)
+    {
+        PHYSICS_TRACE_SCOPE("Record Trajectory");
+        recording_time += delta;
+        recorder->recordFrame(*this, recording_time);
+    }
+
+    if (allocation_counter) stats.allocations = static_cast<uint32_t>(allocation_counter() - start_allocations);
+    profiler.endStep();
+
     // FIXME: GET RID OF THIS EVENTUALLY 
     // Update forces and positions
     // for (PhysicsBody& body : bodies)
@@ -179,4 +456,55 @@ void PhysicsWorld::update(Real delta)
 void PhysicsWorld::setGravity(const Vector6& grav)
 {
     this->grav_acceleration = grav;
+}
+
+void PhysicsWorld::setSpeculativeContacts(bool enabled)
+{
+    speculative_contacts = enabled;
+}
+
+void PhysicsWorld::setDeterministic(bool enabled)
+{
+    deterministic = enabled;
+}
+
+void PhysicsWorld::setSolverTolerance(Real velocity, Real penetration)
+{
+    velocity_tolerance = std::max(velocity, 0.0);
+    penetration_tolerance = std::max(penetration, 0.0);
+}
+
+void PhysicsWorld::setIntegrator(Integrator integrator)
+{
+    this->integrator = integrator;
+}
+
+void PhysicsWorld::setSubsteps(uint32_t count)
+{
+    // Cached impulses are per sub-step, they'd be the wrong size for a different count
+    count = std::max(count, 1u);
+    if (count != substep_count) contact_cache.clear();
+    substep_count = count;
+}
+
+StepStats PhysicsWorld::getStepStats() const
+{
+    return profiler.getStats();
+}
+
+void PhysicsWorld::setProfiling(bool enabled)
+{
+    profiler.enabled = enabled;
+    profiler.reset();
+}
+
+void PhysicsWorld::setAllocationCounter(AllocationCounter counter)
+{
+    allocation_counter = counter;
+}
+
+void PhysicsWorld::setRecorder(TrajectoryRecorder* recorder)
+{
+    this->recorder = recorder;
+    recording_time = 0.0;
 }
\ No newline at end of file
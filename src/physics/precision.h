@@ -0,0 +1,27 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cstdint>
+
+// Scalar and vector types for the whole library, split out so the small maths headers don't need all of physics.h
+#define PRECISION_HIGH
+
+#ifdef PRECISION_HIGH
+    using Real = double;
+    using Vector3 = Eigen::Vector3d;
+    using Quaternion = Eigen::Quaterniond;
+    using Matrix4 = Eigen::Matrix4d;
+    using Matrix3 = Eigen::Matrix3d;
+    using Affine3 = Eigen::Affine3d;
+    using Vector2 = Eigen::Vector2d;
+#else
+    using Real = float;
+    using Vector3 = Eigen::Vector3f;
+    using Quaternion = Eigen::Quaternionf;
+    using Matrix4 = Eigen::Matrix4f;
+    using Matrix3 = Eigen::Matrix3f;
+    using Affine3 = Eigen::Affine3f;
+    using Vector2 = Eigen::Vector2f;
+#endif
+
+using Vector6 = Eigen::Matrix<Real, 6, 1>;
+using BodyID = int32_t;
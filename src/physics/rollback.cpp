@@ -0,0 +1,129 @@
+/*
+    Rollback ring buffer.
+
+    Each slot holds one frame as three contiguous streams over the bodies that can move, then the joints' warm start impulses:
+        positions (3 Real), orientations (x y z w), velocities (6 Real), path times (Real), joint impulses (MAX_JOINT_ROWS Real)
+    Frame n lives in slot n % capacity, so saving the newest frame overwrites the oldest one and restore is a lookup.
+    Static bodies and everything that can't change during a step (shape, mass, material, layer) are left out, that's what snapshots are for.
+    Contact impulses are rebuilt every step so only the joint impulses (which carry over into the next step) need keeping, plus the contact
+    cache when sub-stepping (kept per slot on the side since its size changes from frame to frame).
+*/
+
+#include "physics.h"
+#include <cstring>
+
+static constexpr size_t rollback_body_size = 3 + 4 + 6 + 1;
+
+static size_t GetRollbackSlotSize(size_t bodies, size_t joints)
+{
+    return bodies * rollback_body_size + joints * MAX_JOINT_ROWS;
+}
+
+// True when the bodies that can move are still the ones the ring was set up with (a restored snapshot can keep the count but move the ids)
+bool PhysicsWorld::isRollbackBodySetCurrent() const
+{
+    size_t next = 0;
+    for (BodyID i = 0; i < static_cast<BodyID>(bodies.size()); i++)
+    {
+        if (bodies[i].layer == PhysicsLayer::STATIC) continue;
+        if (next == rollback_bodies.size() || rollback_bodies[next] != i) return false;
+        next++;
+    }
+    return next == rollback_bodies.size();
+}
+
+void PhysicsWorld::setRollbackCapacity(uint32_t frames)
+{
+    rollback_capacity = frames;
+    rollback_bodies.clear();
+    rollback_states.clear();
+    rollback_frames.assign(frames, -1);
+    rollback_joint_count = 0;
+    rollback_contacts.assign(frames, {});
+}
+
+void PhysicsWorld::saveRollbackFrame(uint32_t frame)
+{
+    if (rollback_capacity == 0) return;
+
+    // The moving bodies are gathered the first time (and again if bodies or joints were created since), which throws away the old frames
+    if (rollback_states.empty() || !isRollbackBodySetCurrent() || rollback_joint_count != joints.size())
+    {
+        rollback_bodies.clear();
+        for (BodyID i = 0; i < static_cast<BodyID>(bodies.size()); i++)
+        {
+            if (bodies[i].layer != PhysicsLayer::STATIC) rollback_bodies.push_back(i);
+        }
+        rollback_joint_count = static_cast<uint32_t>(joints.size());
+        rollback_states.assign(rollback_capacity * GetRollbackSlotSize(rollback_bodies.size(), rollback_joint_count), 0.0);
+        rollback_frames.assign(rollback_capacity, -1);
+    }
+
+    uint32_t slot = frame % rollback_capacity;
+    size_t count = rollback_bodies.size();
+    Real* positions = rollback_states.data() + slot * GetRollbackSlotSize(count, rollback_joint_count);
+    Real* orientations = positions + count * 3;
+    Real* velocities = orientations + count * 4;
+    Real* path_times = velocities + count * 6;
+    Real* impulses = path_times + count;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const PhysicsBody& body = bodies[rollback_bodies[i]];
+        std::memcpy(positions + i * 3, body.transform.position.data(), sizeof(Real) * 3);
+        std::memcpy(orientations + i * 4, body.transform.orientation.coeffs().data(), sizeof(Real) * 4);
+        std::memcpy(velocities + i * 6, body.velocity.data(), sizeof(Real) * 6);
+        path_times[i] = body.path_time;
+    }
+
+    for (size_t i = 0; i < rollback_joint_count; i++)
+    {
+        std::memcpy(impulses + i * MAX_JOINT_ROWS, joints[i].accumulated_impulses, sizeof(Real) * MAX_JOINT_ROWS);
+    }
+    rollback_contacts[slot] = contact_cache;
+
+    rollback_frames[slot] = frame;
+}
+
+bool PhysicsWorld::rollbackToFrame(uint32_t frame)
+{
+    if (rollback_capacity == 0) return false;
+
+    uint32_t slot = frame % rollback_capacity;
+    if (rollback_frames[slot] != static_cast<int64_t>(frame)) return false;
+
+    // Bodies created after the frame was saved aren't in it, rewinding around them would leave the world half restored
+    if (!isRollbackBodySetCurrent() || rollback_joint_count != joints.size()) return false;
+
+    size_t count = rollback_bodies.size();
+    const Real* positions = rollback_states.data() + slot * GetRollbackSlotSize(count, rollback_joint_count);
+    const Real* orientations = positions + count * 3;
+    const Real* velocities = orientations + count * 4;
+    const Real* path_times = velocities + count * 6;
+    const Real* impulses = path_times + count;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        PhysicsBody& body = bodies[rollback_bodies[i]];
+        std::memcpy(body.transform.position.data(), positions + i * 3, sizeof(Real) * 3);
+        std::memcpy(body.transform.orientation.coeffs().data(), orientations + i * 4, sizeof(Real) * 4);
+        std::memcpy(body.velocity.data(), velocities + i * 6, sizeof(Real) * 6);
+        body.path_time = path_times[i];
+        body.force = Vector3::Zero();
+        body.torque = Vector3::Zero();
+    }
+
+    for (size_t i = 0; i < rollback_joint_count; i++)
+    {
+        std::memcpy(joints[i].accumulated_impulses, impulses + i * MAX_JOINT_ROWS, sizeof(Real) * MAX_JOINT_ROWS);
+    }
+    contact_cache = rollback_contacts[slot];
+
+    // Frames after the one we went back to are about to be resimulated, drop them so a stale one can't be restored
+    for (uint32_t i = 0; i < rollback_capacity; i++)
+    {
+        if (rollback_frames[i] > static_cast<int64_t>(frame)) rollback_frames[i] = -1;
+    }
+
+    return true;
+}
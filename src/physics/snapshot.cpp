@@ -0,0 +1,503 @@
+/*
+    World snapshots.
+
+    Layout (native endianness, Real sized floats):
+        SnapshotHeader
+        One stream per field, each holding that field for every body in order:
+            positions (3 Real), orientations (x y z w), velocities (6 Real), forces (3 Real), torques (3 Real),
+            masses, restitutions, frictions, friction axes (3 Real), axis frictions, rolling frictions, shapes (SnapshotShape), layers (uint8),
+            flags (uint8), paths (uint32 resource id), path times (Real)
+        Then one stream per joint field in the same way:
+            types (uint8), bodies (2 BodyID), anchors a, anchors b, axes a, axes b (3 Real each), rest orientations (x y z w), distances,
+            warm start impulses (MAX_JOINT_ROWS Real)
+        And the sub-stepping contact cache, one stream per CachedContact field:
+            bodies (2 BodyID), manifold indices (uint32), normals (3 Real), normal impulses, friction impulses (3 Real), rolling impulses (3 Real)
+
+    Every stream is written and read in one pass over the bodies, so a snapshot is basically a handful of memcpys.
+    Inertia isn't stored, it's recomputed from the shape and mass (and skipped when a restored body's shape and mass didn't change).
+    Meshes, heightfields and paths are stored as resource ids, their index in the caller's SnapshotResources tables plus one (0 is none),
+    since a pointer means nothing once the blob leaves the process.
+    Joints replace the world's joints on restore, their rows are rebuilt at the start of the next step from the stored impulses.
+    The sub-stepping contact cache is stored as is, so a restored world warm starts its first step from the same impulses as the original.
+
+    getStateHash lives here too since it hashes the same state a snapshot restores (minus the parts that can't change during a step), contact cache included.
+*/
+
+#include "physics.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static constexpr uint32_t snapshot_magic = 0x53594850;  // "PHYS"
+static constexpr uint32_t snapshot_version = 6;
+
+enum SnapshotFlags : uint32_t
+{
+    SPECULATIVE_CONTACTS = 1 << 0,
+    INTEGRATOR_SHIFT = 8  // The world's Integrator is in bits 8-15 (0, explicit Euler, in snapshots from before it was added)
+};
+
+enum SnapshotBodyFlags : uint8_t
+{
+    CONTINUOUS = 1 << 0
+};
+
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t real_size;  // Snapshots only load into a world with the same precision
+    uint32_t body_count;
+    uint32_t flags;
+    uint32_t substeps;
+    uint32_t joint_count;
+    uint32_t contact_count;
+    Real gravity[6];
+};
+
+// Shape parameters packed per type: sphere (radius), plane (extent x, z), obb (half extents). Meshes and heightfields store their resource id
+struct SnapshotShape
+{
+    uint32_t type;
+    uint32_t resource;
+    Real parameters[3];
+};
+
+static size_t GetSnapshotBodySize()
+{
+    return sizeof(Real) * (3 + 4 + 6 + 3 + 3 + 1 + 1 + 1 + 3 + 1 + 1 + 1) + sizeof(SnapshotShape) + sizeof(uint8_t) * 2 + sizeof(uint32_t);
+}
+
+static size_t GetSnapshotJointSize()
+{
+    return sizeof(uint8_t) + sizeof(BodyID) * 2 + sizeof(Real) * (3 + 3 + 3 + 3 + 4 + 1 + MAX_JOINT_ROWS);
+}
+
+static size_t GetSnapshotContactSize()
+{
+    return sizeof(BodyID) * 2 + sizeof(uint32_t) + sizeof(Real) * (3 + 1 + 3 + 3);
+}
+
+static const SnapshotResources no_resources;
+
+// False when the resource isn't in the table, so it can't be saved
+template <typename T>
+static bool GetResourceID(const std::vector<const T*>& table, const T* resource, uint32_t& id)
+{
+    id = 0;
+    if (resource == nullptr) return true;
+
+    auto it = std::find(table.begin(), table.end(), resource);
+    if (it == table.end()) return false;
+    id = static_cast<uint32_t>(it - table.begin()) + 1;
+    return true;
+}
+
+template <typename T>
+static bool IsValidResourceID(const std::vector<const T*>& table, uint32_t id)
+{
+    return id <= table.size();
+}
+
+template <typename T>
+static const T* GetResource(const std::vector<const T*>& table, uint32_t id)
+{
+    return id == 0 ? nullptr : table[id - 1];
+}
+
+static bool PackShape(const PhysicsShape& shape, const SnapshotResources& resources, SnapshotShape& packed)
+{
+    packed = { .type = static_cast<uint32_t>(shape.type), .resource = 0, .parameters = { 0.0, 0.0, 0.0 } };
+    switch (shape.type)
+    {
+        case ShapeType::SPHERE:
+            packed.parameters[0] = shape.sphere.radius;
+            break;
+        case ShapeType::PLANE:
+            packed.parameters[0] = shape.plane.extent[0];
+            packed.parameters[1] = shape.plane.extent[1];
+            break;
+        case ShapeType::OBB:
+            packed.parameters[0] = shape.obb.half_extent[0];
+            packed.parameters[1] = shape.obb.half_extent[1];
+            packed.parameters[2] = shape.obb.half_extent[2];
+            break;
+        case ShapeType::MESH:
+            return GetResourceID(resources.meshes, shape.mesh.mesh, packed.resource);
+        case ShapeType::HEIGHTFIELD:
+            return GetResourceID(resources.heightfields, shape.heightfield.field, packed.resource);
+        default:
+            break;
+    }
+    return true;
+}
+
+static bool IsValidShape(const SnapshotShape& packed, const SnapshotResources& resources)
+{
+    switch (packed.type)
+    {
+        case ShapeType::MESH:
+            return IsValidResourceID(resources.meshes, packed.resource);
+        case ShapeType::HEIGHTFIELD:
+            return IsValidResourceID(resources.heightfields, packed.resource);
+        default:
+            return packed.type > ShapeType::SHAPE && packed.type < ShapeType::NUM_SHAPES;
+    }
+}
+
+static PhysicsShape UnpackShape(const SnapshotShape& packed, const SnapshotResources& resources)
+{
+    switch (packed.type)
+    {
+        case ShapeType::PLANE:
+            return PhysicsShape::MakePlane(Vector2(packed.parameters[0], packed.parameters[1]));
+        case ShapeType::OBB:
+            return PhysicsShape::MakeOBB(Vector3(packed.parameters[0], packed.parameters[1], packed.parameters[2]));
+        case ShapeType::MESH:
+            return PhysicsShape::MakeMesh(GetResource(resources.meshes, packed.resource));
+        case ShapeType::HEIGHTFIELD:
+            return PhysicsShape::MakeHeightField(GetResource(resources.heightfields, packed.resource));
+        default:
+            return PhysicsShape::MakeSphere(packed.parameters[0]);
+    }
+}
+
+static bool IsSameShape(const PhysicsShape& shape, const PhysicsShape& other)
+{
+    if (shape.type != other.type) return false;
+    switch (shape.type)
+    {
+        case ShapeType::SPHERE:
+            return shape.sphere.radius == other.sphere.radius;
+        case ShapeType::PLANE:
+            return shape.plane.extent == other.plane.extent;
+        case ShapeType::OBB:
+            return shape.obb.half_extent == other.obb.half_extent;
+        case ShapeType::MESH:
+            return shape.mesh.mesh == other.mesh.mesh;
+        case ShapeType::HEIGHTFIELD:
+            return shape.heightfield.field == other.heightfield.field;
+        default:
+            return true;
+    }
+}
+
+bool PhysicsWorld::saveSnapshot(std::vector<uint8_t>& blob, const SnapshotResources* resources) const
+{
+    const SnapshotResources& tables = resources != nullptr ? *resources : no_resources;
+
+    // Resources are looked up first so a body using one that isn't in the tables leaves blob alone
+    for (const PhysicsBody& body : bodies)
+    {
+        SnapshotShape shape;
+        uint32_t path;
+        if (!PackShape(body.shape, tables, shape) || !GetResourceID(tables.paths, body.path, path)) return false;
+    }
+
+    uint32_t count = static_cast<uint32_t>(bodies.size());
+    uint32_t joint_count = static_cast<uint32_t>(joints.size());
+    uint32_t contact_count = static_cast<uint32_t>(contact_cache.size());
+    blob.resize(sizeof(SnapshotHeader) + count * GetSnapshotBodySize() + joint_count * GetSnapshotJointSize() + contact_count * GetSnapshotContactSize());
+    uint8_t* out = blob.data();
+
+    SnapshotHeader header = {
+        .magic = snapshot_magic,
+        .version = snapshot_version,
+        .real_size = sizeof(Real),
+        .body_count = count,
+        .flags = (speculative_contacts ? SnapshotFlags::SPECULATIVE_CONTACTS : 0u) | (static_cast<uint32_t>(integrator) << SnapshotFlags::INTEGRATOR_SHIFT),
+        .substeps = substep_count,
+        .joint_count = joint_count,
+        .contact_count = contact_count
+    };
+    std::memcpy(header.gravity, grav_acceleration.data(), sizeof(header.gravity));
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    auto write = [&](const void* data, size_t size) {
+        std::memcpy(out, data, size);
+        out += size;
+    };
+
+    for (const PhysicsBody& body : bodies) write(body.transform.position.data(), sizeof(Real) * 3);
+    for (const PhysicsBody& body : bodies) write(body.transform.orientation.coeffs().data(), sizeof(Real) * 4);
+    for (const PhysicsBody& body : bodies) write(body.velocity.data(), sizeof(Real) * 6);
+    for (const PhysicsBody& body : bodies) write(body.force.data(), sizeof(Real) * 3);
+    for (const PhysicsBody& body : bodies) write(body.torque.data(), sizeof(Real) * 3);
+    for (const PhysicsBody& body : bodies) write(&body.mass, sizeof(Real));
+    for (const PhysicsBody& body : bodies) write(&body.material.restitution, sizeof(Real));
+    for (const PhysicsBody& body : bodies) write(&body.material.friction, sizeof(Real));
+    for (const PhysicsBody& body : bodies) write(body.material.friction_axis.data(), sizeof(Real) * 3);
+    for (const PhysicsBody& body : bodies) write(&body.material.axis_friction, sizeof(Real));
+    for (const PhysicsBody& body : bodies) write(&body.material.rolling_friction, sizeof(Real));
+
+    for (const PhysicsBody& body : bodies)
+    {
+        SnapshotShape shape;
+        PackShape(body.shape, tables, shape);
+        write(&shape, sizeof(shape));
+    }
+
+    for (const PhysicsBody& body : bodies)
+    {
+        uint8_t layer = static_cast<uint8_t>(body.layer);
+        write(&layer, 1);
+    }
+
+    for (const PhysicsBody& body : bodies)
+    {
+        uint8_t flags = body.continuous ? SnapshotBodyFlags::CONTINUOUS : 0;
+        write(&flags, 1);
+    }
+
+    for (const PhysicsBody& body : bodies)
+    {
+        uint32_t path;
+        GetResourceID(tables.paths, body.path, path);
+        write(&path, sizeof(path));
+    }
+    for (const PhysicsBody& body : bodies) write(&body.path_time, sizeof(Real));
+
+    for (const PhysicsJoint& joint : joints)
+    {
+        uint8_t type = static_cast<uint8_t>(joint.type);
+        write(&type, 1);
+    }
+    for (const PhysicsJoint& joint : joints)
+    {
+        BodyID pair[2] = { joint.a, joint.b };
+        write(pair, sizeof(pair));
+    }
+    for (const PhysicsJoint& joint : joints) write(joint.anchor_a.data(), sizeof(Real) * 3);
+    for (const PhysicsJoint& joint : joints) write(joint.anchor_b.data(), sizeof(Real) * 3);
+    for (const PhysicsJoint& joint : joints) write(joint.axis_a.data(), sizeof(Real) * 3);
+    for (const PhysicsJoint& joint : joints) write(joint.axis_b.data(), sizeof(Real) * 3);
+    for (const PhysicsJoint& joint : joints) write(joint.rest_orientation.coeffs().data(), sizeof(Real) * 4);
+    for (const PhysicsJoint& joint : joints) write(&joint.distance, sizeof(Real));
+    for (const PhysicsJoint& joint : joints) write(joint.accumulated_impulses, sizeof(Real) * MAX_JOINT_ROWS);
+
+    for (const CachedContact& contact : contact_cache)
+    {
+        BodyID pair[2] = { contact.a, contact.b };
+        write(pair, sizeof(pair));
+    }
+    for (const CachedContact& contact : contact_cache) write(&contact.index, sizeof(uint32_t));
+    for (const CachedContact& contact : contact_cache) write(contact.norm.data(), sizeof(Real) * 3);
+    for (const CachedContact& contact : contact_cache) write(&contact.normal_impulse, sizeof(Real));
+    for (const CachedContact& contact : contact_cache) write(contact.friction_impulse.data(), sizeof(Real) * 3);
+    for (const CachedContact& contact : contact_cache) write(contact.rolling_impulse.data(), sizeof(Real) * 3);
+    return true;
+}
+
+bool PhysicsWorld::restoreSnapshot(const std::vector<uint8_t>& blob, const SnapshotResources* resources)
+{
+    return restoreSnapshot(blob.data(), blob.size(), resources);
+}
+
+bool PhysicsWorld::restoreSnapshot(const uint8_t* data, size_t size, const SnapshotResources* resources)
+{
+    const SnapshotResources& tables = resources != nullptr ? *resources : no_resources;
+
+    SnapshotHeader header;
+    if (data == nullptr || size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != snapshot_magic || header.version != snapshot_version || header.real_size != sizeof(Real)) return false;
+    size_t expected_size = sizeof(header) + header.body_count * GetSnapshotBodySize() + header.joint_count * GetSnapshotJointSize() +
+        header.contact_count * GetSnapshotContactSize();
+    if (size != expected_size) return false;
+    if (((header.flags >> SnapshotFlags::INTEGRATOR_SHIFT) & 0xff) > Integrator::SYMPLECTIC_EULER) return false;
+
+    uint32_t count = header.body_count;
+    const uint8_t* in = data + sizeof(header);
+
+    // The shape and path streams are checked before anything is touched so a bad snapshot (or missing resources) leaves the world as it was
+    const uint8_t* shapes = in + count * sizeof(Real) * (3 + 4 + 6 + 3 + 3 + 1 + 1 + 1 + 3 + 1 + 1);
+    const uint8_t* paths = shapes + count * (sizeof(SnapshotShape) + sizeof(uint8_t) * 2);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SnapshotShape packed;
+        uint32_t path;
+        std::memcpy(&packed, shapes + i * sizeof(SnapshotShape), sizeof(packed));
+        std::memcpy(&path, paths + i * sizeof(uint32_t), sizeof(path));
+        if (!IsValidShape(packed, tables) || !IsValidResourceID(tables.paths, path)) return false;
+    }
+
+    // Same for the joints' types and bodies
+    const uint8_t* joint_types = in + count * GetSnapshotBodySize();
+    const uint8_t* joint_bodies = joint_types + header.joint_count * sizeof(uint8_t);
+    for (uint32_t i = 0; i < header.joint_count; i++)
+    {
+        BodyID pair[2];
+        std::memcpy(pair, joint_bodies + i * sizeof(pair), sizeof(pair));
+        bool valid_bodies = pair[0] >= 0 && pair[1] >= 0 && pair[0] < static_cast<int64_t>(count) && pair[1] < static_cast<int64_t>(count) && pair[0] != pair[1];
+        if (joint_types[i] > JointType::DISTANCE || !valid_bodies) return false;
+    }
+
+    // Bodies can't be default constructed, so when the count changed they're rebuilt as placeholders and filled in below
+    if (bodies.size() != count)
+    {
+        bodies.clear();
+        bodies.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bodies.push_back(PhysicsBody(PhysicsShape::MakeSphere(1.0), PhysicsMaterial{}, Vector3::Zero(), Quaternion::Identity(), 0.0, PhysicsLayer::STATIC));
+        }
+    }
+
+    std::memcpy(grav_acceleration.data(), header.gravity, sizeof(header.gravity));
+    speculative_contacts = (header.flags & SnapshotFlags::SPECULATIVE_CONTACTS) != 0;
+    integrator = static_cast<Integrator>((header.flags >> SnapshotFlags::INTEGRATOR_SHIFT) & 0xff);
+    substep_count = std::max(header.substeps, 1u);
+
+    auto read = [&](void* out, size_t size) {
+        std::memcpy(out, in, size);
+        in += size;
+    };
+
+    for (PhysicsBody& body : bodies) read(body.transform.position.data(), sizeof(Real) * 3);
+    for (PhysicsBody& body : bodies) read(body.transform.orientation.coeffs().data(), sizeof(Real) * 4);
+    for (PhysicsBody& body : bodies) read(body.velocity.data(), sizeof(Real) * 6);
+    for (PhysicsBody& body : bodies) read(body.force.data(), sizeof(Real) * 3);
+    for (PhysicsBody& body : bodies) read(body.torque.data(), sizeof(Real) * 3);
+
+    // Mass is read into a temporary so it can be compared when deciding whether the inertia has to be recomputed
+    const uint8_t* masses = in;
+    in += count * sizeof(Real);
+
+    for (PhysicsBody& body : bodies) read(&body.material.restitution, sizeof(Real));
+    for (PhysicsBody& body : bodies) read(&body.material.friction, sizeof(Real));
+    for (PhysicsBody& body : bodies) read(body.material.friction_axis.data(), sizeof(Real) * 3);
+    for (PhysicsBody& body : bodies) read(&body.material.axis_friction, sizeof(Real));
+    for (PhysicsBody& body : bodies) read(&body.material.rolling_friction, sizeof(Real));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        PhysicsBody& body = bodies[i];
+
+        Real mass;
+        SnapshotShape packed;
+        std::memcpy(&mass, masses + i * sizeof(Real), sizeof(Real));
+        read(&packed, sizeof(packed));
+
+        PhysicsShape shape = UnpackShape(packed, tables);
+        if (mass != body.mass || !IsSameShape(body.shape, shape))
+        {
+            // The shape union can't be assigned (Eigen members) but it's trivially destructible, so it's rebuilt in place
+            new (&body.shape) PhysicsShape(shape);
+            body.mass = mass;
+            body.spatial_inertia = SpatialInertia::FromMatrix(GetSpatialInertia(body.shape, mass));
+            body.inverse_inertia = GetInertiaTensor(body.shape, mass).inverse();
+        }
+    }
+
+    for (PhysicsBody& body : bodies)
+    {
+        uint8_t layer;
+        read(&layer, 1);
+        body.layer = static_cast<PhysicsLayer>(layer);
+    }
+
+    for (PhysicsBody& body : bodies)
+    {
+        uint8_t flags;
+        read(&flags, 1);
+        body.continuous = (flags & SnapshotBodyFlags::CONTINUOUS) != 0;
+        body.position_correction = Vector3::Zero();
+    }
+
+    for (PhysicsBody& body : bodies)
+    {
+        uint32_t path;
+        read(&path, sizeof(path));
+        body.path = GetResource(tables.paths, path);
+    }
+    for (PhysicsBody& body : bodies) read(&body.path_time, sizeof(Real));
+
+    joints.assign(header.joint_count, PhysicsJoint{});
+    for (PhysicsJoint& joint : joints)
+    {
+        uint8_t type;
+        read(&type, 1);
+        joint.type = static_cast<JointType>(type);
+    }
+    for (PhysicsJoint& joint : joints)
+    {
+        BodyID pair[2];
+        read(pair, sizeof(pair));
+        joint.a = pair[0];
+        joint.b = pair[1];
+    }
+    for (PhysicsJoint& joint : joints) read(joint.anchor_a.data(), sizeof(Real) * 3);
+    for (PhysicsJoint& joint : joints) read(joint.anchor_b.data(), sizeof(Real) * 3);
+    for (PhysicsJoint& joint : joints) read(joint.axis_a.data(), sizeof(Real) * 3);
+    for (PhysicsJoint& joint : joints) read(joint.axis_b.data(), sizeof(Real) * 3);
+    for (PhysicsJoint& joint : joints) read(joint.rest_orientation.coeffs().data(), sizeof(Real) * 4);
+    for (PhysicsJoint& joint : joints) read(&joint.distance, sizeof(Real));
+    for (PhysicsJoint& joint : joints) read(joint.accumulated_impulses, sizeof(Real) * MAX_JOINT_ROWS);
+    rebuildJointPairs();
+
+    // Cached contacts are only ever matched against the current collisions by body ids, so a stale or odd entry is just never used
+    contact_cache.assign(header.contact_count, CachedContact{});
+    for (CachedContact& contact : contact_cache)
+    {
+        BodyID pair[2];
+        read(pair, sizeof(pair));
+        contact.a = pair[0];
+        contact.b = pair[1];
+    }
+    for (CachedContact& contact : contact_cache) read(&contact.index, sizeof(uint32_t));
+    for (CachedContact& contact : contact_cache) read(contact.norm.data(), sizeof(Real) * 3);
+    for (CachedContact& contact : contact_cache) read(&contact.normal_impulse, sizeof(Real));
+    for (CachedContact& contact : contact_cache) read(contact.friction_impulse.data(), sizeof(Real) * 3);
+    for (CachedContact& contact : contact_cache) read(contact.rolling_impulse.data(), sizeof(Real) * 3);
+
+    // The ring's frames belong to the world that was just replaced, even if the body ids line up
+    rollback_frames.assign(rollback_capacity, -1);
+
+    return true;
+}
+
+// FNV-1a over the raw bits, so -0.0 and 0.0 (or two NaNs) hash differently. That's on purpose, the point is to catch any divergence
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t PhysicsWorld::getStateHash() const
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint32_t count = static_cast<uint32_t>(bodies.size());
+    hash = HashBytes(hash, &count, sizeof(count));
+
+    for (const PhysicsBody& body : bodies)
+    {
+        hash = HashBytes(hash, body.transform.position.data(), sizeof(Real) * 3);
+        hash = HashBytes(hash, body.transform.orientation.coeffs().data(), sizeof(Real) * 4);
+        hash = HashBytes(hash, body.velocity.data(), sizeof(Real) * 6);
+        hash = HashBytes(hash, &body.path_time, sizeof(Real));
+    }
+
+    // The cached impulses warm start the next step when sub-stepping, two worlds that differ only here still diverge
+    // (it's always empty without sub-stepping, which keeps those hashes the same as before the cache was hashed)
+    uint32_t contact_count = static_cast<uint32_t>(contact_cache.size());
+    if (contact_count > 0) hash = HashBytes(hash, &contact_count, sizeof(contact_count));
+    for (const CachedContact& contact : contact_cache)
+    {
+        hash = HashBytes(hash, &contact.a, sizeof(BodyID));
+        hash = HashBytes(hash, &contact.b, sizeof(BodyID));
+        hash = HashBytes(hash, &contact.index, sizeof(uint32_t));
+        hash = HashBytes(hash, contact.norm.data(), sizeof(Real) * 3);
+        hash = HashBytes(hash, &contact.normal_impulse, sizeof(Real));
+        hash = HashBytes(hash, contact.friction_impulse.data(), sizeof(Real) * 3);
+        hash = HashBytes(hash, contact.rolling_impulse.data(), sizeof(Real) * 3);
+    }
+
+    return hash;
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include "precision.h"
+
+/*
+    Compact spatial algebra (Featherstone's notation, angular part first then linear).
+    Rigid body inertias are kept as mass, centre of mass and a symmetric 3x3 about the centre of mass (10 numbers instead of a dense 6x6),
+    and Plucker transforms as a rotation plus a translation, with the products written out so they skip the zero and repeated blocks.
+*/
+
+using SpatialMatrix = Eigen::Matrix<Real, 6, 6>;
+
+inline Matrix3 Skew(const Vector3& v)
+{
+    Matrix3 skew;
+    skew << 0.0, -v[2], v[1],
+            v[2], 0.0, -v[0],
+            -v[1], v[0], 0.0;
+    return skew;
+}
+
+// v x m for motion vectors
+inline Vector6 MotionCross(const Vector6& v, const Vector6& m)
+{
+    Vector6 product;
+    product << v[1] * m[2] - v[2] * m[1],
+               v[2] * m[0] - v[0] * m[2],
+               v[0] * m[1] - v[1] * m[0],
+               v[1] * m[5] - v[2] * m[4] + v[4] * m[2] - v[5] * m[1],
+               v[2] * m[3] - v[0] * m[5] + v[5] * m[0] - v[3] * m[2],
+               v[0] * m[4] - v[1] * m[3] + v[3] * m[1] - v[4] * m[0];
+    return product;
+}
+
+// v x* f for force vectors
+inline Vector6 ForceCross(const Vector6& v, const Vector6& f)
+{
+    Vector6 product;
+    product << v[1] * f[2] - v[2] * f[1] + v[4] * f[5] - v[5] * f[4],
+               v[2] * f[0] - v[0] * f[2] + v[5] * f[3] - v[3] * f[5],
+               v[0] * f[1] - v[1] * f[0] + v[3] * f[4] - v[4] * f[3],
+               v[1] * f[5] - v[2] * f[4],
+               v[2] * f[3] - v[0] * f[5],
+               v[0] * f[4] - v[1] * f[3];
+    return product;
+}
+
+struct SymmetricMatrix3
+{
+    Real xx = 0.0, yy = 0.0, zz = 0.0;
+    Real xy = 0.0, xz = 0.0, yz = 0.0;
+
+    static SymmetricMatrix3 FromMatrix(const Matrix3& m)
+    {
+        return { .xx = m(0, 0), .yy = m(1, 1), .zz = m(2, 2), .xy = m(0, 1), .xz = m(0, 2), .yz = m(1, 2) };
+    }
+
+    Matrix3 toMatrix() const
+    {
+        Matrix3 m;
+        m << xx, xy, xz,
+             xy, yy, yz,
+             xz, yz, zz;
+        return m;
+    }
+
+    Vector3 operator*(const Vector3& v) const
+    {
+        return Vector3(xx * v[0] + xy * v[1] + xz * v[2], xy * v[0] + yy * v[1] + yz * v[2], xz * v[0] + yz * v[1] + zz * v[2]);
+    }
+
+    SymmetricMatrix3 inverse() const
+    {
+        SymmetricMatrix3 cofactor = {
+            .xx = yy * zz - yz * yz, .yy = xx * zz - xz * xz, .zz = xx * yy - xy * xy,
+            .xy = xz * yz - xy * zz, .xz = xy * yz - xz * yy, .yz = xy * xz - xx * yz
+        };
+        Real inverse_determinant = 1.0 / (xx * cofactor.xx + xy * cofactor.xy + xz * cofactor.xz);
+        return {
+            .xx = cofactor.xx * inverse_determinant, .yy = cofactor.yy * inverse_determinant, .zz = cofactor.zz * inverse_determinant,
+            .xy = cofactor.xy * inverse_determinant, .xz = cofactor.xz * inverse_determinant, .yz = cofactor.yz * inverse_determinant
+        };
+    }
+};
+
+struct SpatialInertia
+{
+    Real mass = 0.0;
+    Vector3 center_of_mass = Vector3::Zero();
+    SymmetricMatrix3 inertia;  // About the centre of mass
+
+    // Dense form [Ic - m cx cx, m cx; -m cx, m] for code that still needs the matrix. FromMatrix assumes the matrix has that form
+    SpatialMatrix toMatrix() const
+    {
+        Matrix3 c = Skew(center_of_mass);
+        SpatialMatrix m;
+        m << inertia.toMatrix() - mass * c * c, mass * c,
+             -mass * c, mass * Matrix3::Identity();
+        return m;
+    }
+
+    static SpatialInertia FromMatrix(const SpatialMatrix& m)
+    {
+        Real mass = m(3, 3);
+        Matrix3 c = mass > 0.0 ? Matrix3(m.topRightCorner<3, 3>() / mass) : Matrix3::Zero();
+        return { .mass = mass, .center_of_mass = Vector3(c(2, 1), c(0, 2), c(1, 0)), .inertia = SymmetricMatrix3::FromMatrix(m.topLeftCorner<3, 3>() + mass * c * c) };
+    }
+
+    // I * v: the linear momentum of the centre of mass, then the angular momentum about the origin
+    Vector6 operator*(const Vector6& motion) const
+    {
+        const Real wx = motion[0], wy = motion[1], wz = motion[2];
+        const Real cx = center_of_mass[0], cy = center_of_mass[1], cz = center_of_mass[2];
+        const Real lx = mass * (motion[3] + wy * cz - wz * cy);
+        const Real ly = mass * (motion[4] + wz * cx - wx * cz);
+        const Real lz = mass * (motion[5] + wx * cy - wy * cx);
+
+        Vector6 momentum;
+        momentum[0] = inertia.xx * wx + inertia.xy * wy + inertia.xz * wz + cy * lz - cz * ly;
+        momentum[1] = inertia.xy * wx + inertia.yy * wy + inertia.yz * wz + cz * lx - cx * lz;
+        momentum[2] = inertia.xz * wx + inertia.yz * wy + inertia.zz * wz + cx * ly - cy * lx;
+        momentum[3] = lx;
+        momentum[4] = ly;
+        momentum[5] = lz;
+        return momentum;
+    }
+
+    // I^-1 * f, the same steps as above run backwards (only a 3x3 inverse instead of a 6x6 one)
+    Vector6 solve(const Vector6& force) const
+    {
+        Vector3 linear(force[3], force[4], force[5]);
+        Vector3 w = inertia.inverse() * (Vector3(force[0], force[1], force[2]) - center_of_mass.cross(linear));
+        Vector6 motion;
+        motion << w, linear / mass - w.cross(center_of_mass);
+        return motion;
+    }
+};
+
+// Plucker transform into a frame rotated by rotation (parent to child coordinates) with its origin at translation (parent coordinates)
+struct SpatialTransform
+{
+    Matrix3 rotation = Matrix3::Identity();
+    Vector3 translation = Vector3::Zero();
+
+    SpatialMatrix toMatrix() const
+    {
+        SpatialMatrix m = SpatialMatrix::Zero();
+        m.topLeftCorner<3, 3>() = rotation;
+        m.bottomRightCorner<3, 3>() = rotation;
+        m.bottomLeftCorner<3, 3>() = -rotation * Skew(translation);
+        return m;
+    }
+
+    // X * m for motion vectors
+    Vector6 apply(const Vector6& motion) const
+    {
+        Vector3 w(motion[0], motion[1], motion[2]);
+        Vector3 v(motion[3], motion[4], motion[5]);
+        Vector6 result;
+        result << rotation * w, rotation * (v - translation.cross(w));
+        return result;
+    }
+
+    // X^T * f, takes a force from the child frame back to the parent
+    Vector6 applyTranspose(const Vector6& force) const
+    {
+        Vector3 angular = rotation.transpose() * Vector3(force[0], force[1], force[2]);
+        Vector3 linear = rotation.transpose() * Vector3(force[3], force[4], force[5]);
+        Vector6 result;
+        result << angular + translation.cross(linear), linear;
+        return result;
+    }
+
+    // X^T * I * X for a symmetric (e.g. articulated) inertia: rotate each 3x3 block, then shift by the translation
+    // Products with the translation's skew matrix are done as cross products on rows / columns
+    SpatialMatrix transformInertia(const SpatialMatrix& inertia) const
+    {
+        Matrix3 a = rotation.transpose() * (inertia.topLeftCorner<3, 3>() * rotation);
+        Matrix3 b = rotation.transpose() * (inertia.topRightCorner<3, 3>() * rotation);
+        Matrix3 c = rotation.transpose() * (inertia.bottomRightCorner<3, 3>() * rotation);
+
+        Matrix3 tc, bt, tct;
+        for (int i = 0; i < 3; i++)
+        {
+            tc.col(i) = translation.cross(c.col(i));
+            bt.row(i) = -translation.cross(b.row(i).transpose()).transpose();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            tct.row(i) = -translation.cross(tc.row(i).transpose()).transpose();
+        }
+
+        SpatialMatrix result;
+        result.topLeftCorner<3, 3>() = a - bt - bt.transpose() - tct;
+        result.topRightCorner<3, 3>() = b + tc;
+        result.bottomLeftCorner<3, 3>() = (b + tc).transpose();
+        result.bottomRightCorner<3, 3>() = c;
+        return result;
+    }
+};
@@ -0,0 +1,90 @@
+#include "spline_path.h"
+#include <algorithm>
+#include <cmath>
+
+SplinePath::SplinePath(const std::vector<Vector3>& points, Real duration, bool looped, Real tension)
+:duration(duration), looped(looped)
+{
+    size_t count = points.size();
+    size_t segment_count = count < 2 ? count : (looped ? count : count - 1);
+    segments.reserve(segment_count);
+
+    for (size_t i = 0; i < segment_count; i++)
+    {
+        // Open paths repeat the end points as their own neighbours, looped ones wrap around
+        const Vector3& start = points[i];
+        const Vector3& end = points[(i + 1) % count];
+        const Vector3& prev = (i == 0 && !looped) ? start : points[(i + count - 1) % count];
+        const Vector3& next = (i + 2 >= count && !looped) ? end : points[(i + 2) % count];
+
+        // generate_spline's weights gathered by power of u
+        segments.push_back(Segment{
+            .c0 = start,
+            .c1 = 0.5 * tension * (end - prev),
+            .c2 = tension * prev + 0.5 * (tension - 6.0) * start - (tension - 3.0) * end - 0.5 * tension * next,
+            .c3 = -0.5 * tension * prev + 0.5 * (4.0 - tension) * start + 0.5 * (tension - 4.0) * end + 0.5 * tension * next
+        });
+    }
+
+    // A single point is a path that never moves
+    if (count == 1) segments[0].c1 = segments[0].c2 = segments[0].c3 = Vector3::Zero();
+
+    segment_duration = segments.empty() ? 0.0 : duration / segments.size();
+}
+
+uint32_t SplinePath::getSegment(Real time, Real& u) const
+{
+    uint32_t count = static_cast<uint32_t>(segments.size());
+    if (segment_duration <= 0.0)
+    {
+        u = 0.0;
+        return 0;
+    }
+
+    if (looped)
+    {
+        time = std::fmod(time, duration);
+        if (time < 0.0) time += duration;
+    }
+    else if (time <= 0.0)
+    {
+        u = 0.0;
+        return 0;
+    }
+    else if (time >= duration)
+    {
+        u = 1.0;
+        return count - 1;
+    }
+
+    Real scaled = time / segment_duration;
+    uint32_t segment = std::min(static_cast<uint32_t>(scaled), count - 1);
+    u = scaled - segment;
+    return segment;
+}
+
+Vector3 SplinePath::getPosition(Real time) const
+{
+    if (segments.empty()) return Vector3::Zero();
+
+    Real u;
+    const Segment& s = segments[getSegment(time, u)];
+    return s.c0 + u * (s.c1 + u * (s.c2 + u * s.c3));
+}
+
+void SplinePath::evaluate(Real time, Vector3& position, Vector3& velocity) const
+{
+    if (segments.empty())
+    {
+        position = velocity = Vector3::Zero();
+        return;
+    }
+
+    Real u;
+    const Segment& s = segments[getSegment(time, u)];
+    position = s.c0 + u * (s.c1 + u * (s.c2 + u * s.c3));
+
+    // Open paths are parked at their ends outside [0, duration]
+    bool parked = segment_duration <= 0.0 || (!looped && (time <= 0.0 || time >= duration));
+    velocity = parked ? Vector3::Zero() : Vector3((s.c1 + u * (2.0 * s.c2 + u * 3.0 * s.c3)) / segment_duration);
+}
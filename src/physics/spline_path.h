@@ -0,0 +1,38 @@
+#pragma once
+#include "physics.h"
+#include <cstdint>
+
+/*
+    Catmull-Rom paths for kinematic bodies (moving platforms, lifts, conveyors).
+    The control points are turned into one cubic per segment when the path is built (same basis and tension as the spline demo's generate_spline),
+    with every segment taking the same time, so following the path is a segment lookup and one polynomial (plus its derivative) per step.
+*/
+
+class SplinePath
+{
+    private:
+        // Per segment: p(u) = c0 + u * (c1 + u * (c2 + u * c3)) for u in [0, 1]
+        struct Segment
+        {
+            Vector3 c0, c1, c2, c3;
+        };
+        std::vector<Segment> segments;
+
+        Real duration = 0.0;
+        Real segment_duration = 0.0;
+        bool looped = false;
+
+        // Maps a time on the path to a segment and the fraction through it
+        uint32_t getSegment(Real time, Real& u) const;
+
+    public:
+        // Takes duration seconds to go from the first point to the last (or back to the first when looped)
+        // Open paths stop at the ends, looped paths join the last point back to the first and wrap around
+        SplinePath(const std::vector<Vector3>& points, Real duration, bool looped = false, Real tension = 1.0);
+
+        Real getDuration() const { return duration; }
+        bool isLooped() const { return looped; }
+
+        Vector3 getPosition(Real time) const;
+        void evaluate(Real time, Vector3& position, Vector3& velocity) const;
+};
@@ -0,0 +1,115 @@
+#include "step_profiler.h"
+#include <algorithm>
+
+const char* GetStepPhaseName(StepPhase phase)
+{
+    switch (phase)
+    {
+        case StepPhase::INTEGRATE_VELOCITIES:
+            return "Integrate Velocities";
+        case StepPhase::BROADPHASE:
+            return "Broadphase";
+        case StepPhase::NARROWPHASE:
+            return "Narrowphase";
+        case StepPhase::RESOLVE_VELOCITIES:
+            return "Resolve Velocities";
+        case StepPhase::INTEGRATE_POSITIONS:
+            return "Integrate Positions";
+        case StepPhase::RESOLVE_POSITIONS:
+            return "Resolve Positions";
+        default:
+            return "Unknown";
+    }
+}
+
+void StepProfiler::beginStep()
+{
+    current = StepSample{};
+    if (enabled) step_start = std::chrono::steady_clock::now();
+}
+
+void StepProfiler::endStep()
+{
+    if (!enabled) return;
+
+    current.total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - step_start).count();
+
+    samples[next] = current;
+    next = (next + 1) % window_size;
+    count = std::min(count + 1, window_size);
+}
+
+StepStats StepProfiler::getStats() const
+{
+    StepStats stats;
+    if (count == 0) return stats;
+
+    stats.steps = count;
+    stats.last = samples[(next + window_size - 1) % window_size];
+
+    // Counters are averaged in doubles and rounded back so short windows don't always round down to 0
+    double pairs_tested = 0.0, pairs_colliding = 0.0, speculative_pairs = 0.0, contacts = 0.0, islands = 0.0, velocity_iterations = 0.0, position_iterations = 0.0, bodies = 0.0, allocations = 0.0, arena_bytes = 0.0, stopped_bodies = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const StepSample& sample = samples[i];
+        for (uint32_t j = 0; j < NUM_STEP_PHASES; j++)
+        {
+            stats.average.phase_time[j] += sample.phase_time[j];
+            stats.peak.phase_time[j] = std::max(stats.peak.phase_time[j], sample.phase_time[j]);
+        }
+        stats.average.total_time += sample.total_time;
+        stats.peak.total_time = std::max(stats.peak.total_time, sample.total_time);
+
+        bodies += sample.bodies;
+        pairs_tested += sample.pairs_tested;
+        pairs_colliding += sample.pairs_colliding;
+        speculative_pairs += sample.speculative_pairs;
+        contacts += sample.contacts;
+        islands += sample.islands;
+        velocity_iterations += sample.velocity_iterations;
+        position_iterations += sample.position_iterations;
+        allocations += sample.allocations;
+        arena_bytes += sample.arena_bytes;
+        stopped_bodies += sample.stopped_bodies;
+
+        stats.peak.bodies = std::max(stats.peak.bodies, sample.bodies);
+        stats.peak.pairs_tested = std::max(stats.peak.pairs_tested, sample.pairs_tested);
+        stats.peak.pairs_colliding = std::max(stats.peak.pairs_colliding, sample.pairs_colliding);
+        stats.peak.speculative_pairs = std::max(stats.peak.speculative_pairs, sample.speculative_pairs);
+        stats.peak.contacts = std::max(stats.peak.contacts, sample.contacts);
+        stats.peak.islands = std::max(stats.peak.islands, sample.islands);
+        stats.peak.velocity_iterations = std::max(stats.peak.velocity_iterations, sample.velocity_iterations);
+        stats.peak.position_iterations = std::max(stats.peak.position_iterations, sample.position_iterations);
+        stats.peak.allocations = std::max(stats.peak.allocations, sample.allocations);
+        stats.peak.arena_bytes = std::max(stats.peak.arena_bytes, sample.arena_bytes);
+        stats.peak.stopped_bodies = std::max(stats.peak.stopped_bodies, sample.stopped_bodies);
+    }
+
+    for (uint32_t j = 0; j < NUM_STEP_PHASES; j++)
+    {
+        stats.average.phase_time[j] /= count;
+    }
+    stats.average.total_time /= count;
+
+    auto average = [&](double sum) { return static_cast<uint32_t>(sum / count + 0.5); };
+    stats.average.bodies = average(bodies);
+    stats.average.pairs_tested = average(pairs_tested);
+    stats.average.pairs_colliding = average(pairs_colliding);
+    stats.average.speculative_pairs = average(speculative_pairs);
+    stats.average.contacts = average(contacts);
+    stats.average.islands = average(islands);
+    stats.average.velocity_iterations = average(velocity_iterations);
+    stats.average.position_iterations = average(position_iterations);
+    stats.average.allocations = average(allocations);
+    stats.average.arena_bytes = average(arena_bytes);
+    stats.average.stopped_bodies = average(stopped_bodies);
+
+    return stats;
+}
+
+void StepProfiler::reset()
+{
+    next = 0;
+    count = 0;
+    current = StepSample{};
+}
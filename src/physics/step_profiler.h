@@ -0,0 +1,104 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/*
+    Lightweight per-step profiling for PhysicsWorld::update.
+    Each phase is timed once per step (no per-pair timers) so it's cheap enough to leave on.
+    The last window_size steps are kept in a ring buffer so averages and peaks can be read back at any time.
+*/
+
+enum StepPhase : uint32_t
+{
+    INTEGRATE_VELOCITIES,
+    BROADPHASE,
+    NARROWPHASE,
+    RESOLVE_VELOCITIES,
+    INTEGRATE_POSITIONS,
+    RESOLVE_POSITIONS,
+    NUM_STEP_PHASES
+};
+
+const char* GetStepPhaseName(StepPhase phase);
+
+// Returns the number of heap allocations made so far
+using AllocationCounter = uint64_t (*)();
+
+struct StepSample
+{
+    // Seconds
+    double phase_time[NUM_STEP_PHASES] = {};
+    double total_time = 0.0;
+
+    uint32_t bodies = 0;
+    uint32_t pairs_tested = 0;
+    uint32_t pairs_colliding = 0;
+    uint32_t speculative_pairs = 0;
+    uint32_t contacts = 0;
+    uint32_t islands = 0;
+
+    // Dynamic bodies whose velocity or transform went non finite this step (e.g. a fast spinning thin box under explicit Euler), they're stopped
+    uint32_t stopped_bodies = 0;
+
+    // The most iterations any island needed before its residual dropped under the solver tolerance (or it hit the limit)
+    uint32_t velocity_iterations = 0;
+    uint32_t position_iterations = 0;
+
+    // Heap allocations during the step (only counted when the world has an allocation counter) and frame arena bytes used
+    uint32_t allocations = 0;
+    uint32_t arena_bytes = 0;
+};
+
+struct StepStats
+{
+    StepSample last;
+    StepSample average;
+    StepSample peak;
+
+    // Number of steps the average / peak cover (up to the window size)
+    uint32_t steps = 0;
+};
+
+class StepProfiler
+{
+    private:
+        static constexpr uint32_t window_size = 64;
+
+        StepSample samples[window_size];
+        uint32_t next = 0;
+        uint32_t count = 0;
+
+        StepSample current;
+        std::chrono::steady_clock::time_point step_start;
+
+    public:
+        bool enabled = true;
+
+        void beginStep();
+        void endStep();
+
+        StepSample& getCurrent() { return current; }
+        StepStats getStats() const;
+        void reset();
+
+        // Adds the time from construction to destruction to a phase of the current step
+        class ScopedTimer
+        {
+            private:
+                StepProfiler& profiler;
+                StepPhase phase;
+                std::chrono::steady_clock::time_point start;
+
+            public:
+                ScopedTimer(StepProfiler& profiler, StepPhase phase)
+                :profiler(profiler), phase(phase)
+                {
+                    if (profiler.enabled) start = std::chrono::steady_clock::now();
+                }
+
+                ~ScopedTimer()
+                {
+                    if (profiler.enabled) profiler.current.phase_time[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+        };
+};
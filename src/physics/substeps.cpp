@@ -0,0 +1,152 @@
+/*
+    Sub-stepping solver (temporal Gauss-Seidel, as in Box2D v3's soft step).
+
+    Collision detection runs once per step, then the step is cut into substep_count sub-steps that each:
+        integrate velocities (gravity), warm start with the last sub-step's impulses,
+        solve every joint and contact once with the penetration pushed out by a soft spring,
+        integrate positions,
+        relax: solve once more without the push so the push doesn't turn into velocity.
+    Contact depths are kept up to date by tracking the contact points on both bodies, so later sub-steps see how far the bodies have
+    moved and there's no separate position pass. Restitution is applied once at the end from the approach speed at the start of the step.
+
+    More smaller steps converge much better than more iterations on one big step (each sub-step starts from a state that's already nearly solved),
+    so 4 sub-steps with 2 passes each stack better than 10 velocity plus 10 position iterations.
+
+    One pass per sub-step can't carry the weight of a stack up from nothing though, so unlike the default solver the contact impulses are kept
+    from step to step (contact_cache) and the first sub-step starts from last step's answer.
+*/
+
+#include "physics.h"
+#include "trace.h"
+#include <algorithm>
+
+static bool IsBefore(const CachedContact& contact, BodyID a, BodyID b, uint32_t index)
+{
+    if (contact.a != a) return contact.a < a;
+    if (contact.b != b) return contact.b < b;
+    return contact.index < index;
+}
+
+// Collisions of one pair are next to each other, index is the collision's place in its pair's run
+template <typename Func>
+static void ForEachManifoldIndex(FrameArray<Collision>& collisions, Func func)
+{
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < collisions.size(); i++)
+    {
+        bool same_pair = i > 0 && collisions[i].a == collisions[i - 1].a && collisions[i].b == collisions[i - 1].b;
+        index = same_pair ? index + 1 : 0;
+        func(collisions[i], index);
+    }
+}
+
+// A cached contact is only used if the manifold still has a point at its index and the normal hasn't turned much
+void PhysicsWorld::loadCachedImpulses()
+{
+    if (contact_cache.empty()) return;
+
+    ForEachManifoldIndex(collisions, [&](Collision& collision, uint32_t index) {
+        auto it = std::partition_point(contact_cache.begin(), contact_cache.end(), [&](const CachedContact& contact) {
+            return IsBefore(contact, collision.a, collision.b, index);
+        });
+        if (it == contact_cache.end() || it->a != collision.a || it->b != collision.b || it->index != index) return;
+        if (it->norm.dot(collision.norm) < 0.95) return;
+
+        collision.accumulated_impulse = it->normal_impulse;
+        for (int i = 0; i < 2; i++)
+        {
+            collision.accumulated_friction[i] = collision.tangents[i].dot(it->friction_impulse);
+            collision.accumulated_rolling[i] = collision.tangents[i].dot(it->rolling_impulse);
+        }
+    });
+}
+
+void PhysicsWorld::storeCachedImpulses()
+{
+    contact_cache.clear();
+    ForEachManifoldIndex(collisions, [&](Collision& collision, uint32_t index) {
+        contact_cache.push_back(CachedContact{
+            .a = collision.a,
+            .b = collision.b,
+            .index = index,
+            .norm = collision.norm,
+            .normal_impulse = collision.accumulated_impulse,
+            .friction_impulse = collision.accumulated_friction[0] * collision.tangents[0] + collision.accumulated_friction[1] * collision.tangents[1],
+            .rolling_impulse = collision.accumulated_rolling[0] * collision.tangents[0] + collision.accumulated_rolling[1] * collision.tangents[1]
+        });
+    });
+
+    // Pairs only come out sorted in deterministic mode, otherwise they're in the broadphase's sweep order
+    auto is_before = [](const CachedContact& x, const CachedContact& y) { return IsBefore(x, y.a, y.b, y.index); };
+    if (!std::is_sorted(contact_cache.begin(), contact_cache.end(), is_before))
+    {
+        std::sort(contact_cache.begin(), contact_cache.end(), is_before);
+    }
+}
+
+void PhysicsWorld::solveSubsteps(Real delta)
+{
+    Real h = delta / substep_count;
+    Real inverse_h = 1.0 / h;
+
+    // Stiffer than a quarter of the sub-step rate and the spring can't be resolved, it just overshoots
+    SoftConstraint soft = SoftConstraint::Make(std::min(substepContactHertz, 0.25 * inverse_h), substepContactDampingRatio, h);
+
+    // The world space inertias are kept for the whole step, only the velocities go back and forth around each integration
+    prepareSolverBodies();
+    for (Collision& collision : collisions)
+    {
+        prepareCollisionVelocities(collision);
+    }
+    loadCachedImpulses();
+
+    for (uint32_t i = 0; i < substep_count; i++)
+    {
+        PHYSICS_TRACE_SCOPE("Substep");
+        integrateVelocities(h);
+        loadSolverVelocities();
+
+        // Joint rows are rebuilt from the current transforms (which also warm starts them)
+        for (PhysicsJoint& joint : joints)
+        {
+            prepareJoint(joint, h);
+        }
+
+        for (const Collision& collision : collisions)
+        {
+            warmStartCollision(collision);
+        }
+
+        for (PhysicsJoint& joint : joints)
+        {
+            handleJointVelocities(joint);
+        }
+
+        for (Collision& collision : collisions)
+        {
+            handleSoftCollisionVelocities(collision, inverse_h, soft, true);
+        }
+
+        storeSolverVelocities();
+        integratePositions(h);
+        loadSolverVelocities();
+
+        for (PhysicsJoint& joint : joints)
+        {
+            handleJointVelocities(joint, false);
+        }
+
+        for (Collision& collision : collisions)
+        {
+            handleSoftCollisionVelocities(collision, inverse_h, soft, false);
+        }
+        storeSolverVelocities();
+    }
+
+    for (Collision& collision : collisions)
+    {
+        applyRestitution(collision);
+    }
+    storeSolverVelocities();
+    storeCachedImpulses();
+}
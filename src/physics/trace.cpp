@@ -0,0 +1,136 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Power of 2 so the write index can be masked instead of wrapped
+static constexpr uint64_t trace_buffer_size = 1 << 16;
+
+struct TraceBuffer
+{
+    TraceEvent events[trace_buffer_size];
+
+    // Total events ever written, only the owning thread writes it
+    std::atomic<uint64_t> head = 0;
+
+    // Events before this were cleared (kept separate from head so the owning thread stays the only writer of head)
+    std::atomic<uint64_t> tail = 0;
+
+    uint32_t thread_id = 0;
+    std::string thread_name;
+};
+
+// Buffers are owned by the registry so they can still be written out after their thread exits
+// The mutex is only taken when a thread records its first event and when the trace is written / cleared
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+static TraceRegistry& GetTraceRegistry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+static TraceBuffer& GetThreadTraceBuffer()
+{
+    thread_local TraceBuffer* buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        TraceRegistry& registry = GetTraceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        registry.buffers.push_back(std::make_unique<TraceBuffer>());
+        buffer = registry.buffers.back().get();
+        buffer->thread_id = static_cast<uint32_t>(registry.buffers.size());
+    }
+    return *buffer;
+}
+
+void TraceRecord(const char* name, TraceEventType type)
+{
+    TraceBuffer& buffer = GetThreadTraceBuffer();
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - GetTraceRegistry().epoch).count();
+
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head & (trace_buffer_size - 1)] = TraceEvent{ .name = name, .timestamp = timestamp, .type = type };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(const char* name)
+{
+    TraceBuffer& buffer = GetThreadTraceBuffer();
+    std::lock_guard<std::mutex> lock(GetTraceRegistry().mutex);
+    buffer.thread_name = name;
+}
+
+static void WriteJsonString(std::ofstream& file, const char* string)
+{
+    file << '"';
+    for (const char* c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\') file << '\\';
+        file << *c;
+    }
+    file << '"';
+}
+
+bool WriteChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file) return false;
+
+    TraceRegistry& registry = GetTraceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (const std::unique_ptr<TraceBuffer>& buffer : registry.buffers)
+    {
+        if (!buffer->thread_name.empty())
+        {
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":";
+            WriteJsonString(file, buffer->thread_name.c_str());
+            file << "}}";
+            first = false;
+        }
+
+        // Only the newest trace_buffer_size events are still in the ring
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t start = (head > trace_buffer_size) ? head - trace_buffer_size : 0;
+        start = std::max(start, buffer->tail.load(std::memory_order_relaxed));
+        for (uint64_t i = start; i < head; i++)
+        {
+            const TraceEvent& event = buffer->events[i & (trace_buffer_size - 1)];
+
+            // Chrome trace timestamps are in microseconds
+            file << (first ? "" : ",") << "\n{\"name\":";
+            WriteJsonString(file, event.name);
+            file << ",\"ph\":\"" << static_cast<char>(event.type) << "\",\"ts\":" << event.timestamp / 1000.0 << ",\"pid\":1,\"tid\":" << buffer->thread_id << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+
+    return static_cast<bool>(file);
+}
+
+void ClearTrace()
+{
+    TraceRegistry& registry = GetTraceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for (const std::unique_ptr<TraceBuffer>& buffer : registry.buffers)
+    {
+        buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/*
+    Optional timeline tracing, compiled in when PHYSICS_TRACING is defined (cmake -DPHYSICS_TRACING=ON).
+    Every thread records begin / end events into its own ring buffer (single writer, so no locks on the hot path).
+    WriteChromeTrace dumps all buffers as Chrome trace JSON that chrome://tracing and Perfetto can open.
+    Call it between steps, events written while it runs may be torn.
+*/
+
+enum class TraceEventType : char
+{
+    BEGIN = 'B',
+    END = 'E'
+};
+
+struct TraceEvent
+{
+    // Names must be string literals (or otherwise live until the trace is written)
+    const char* name;
+    uint64_t timestamp;  // Nanoseconds since the first traced event
+    TraceEventType type;
+};
+
+void TraceRecord(const char* name, TraceEventType type);
+void SetTraceThreadName(const char* name);
+
+// Returns false if the file couldn't be opened
+bool WriteChromeTrace(const std::string& path);
+void ClearTrace();
+
+struct TraceScope
+{
+    const char* name;
+
+    TraceScope(const char* name)
+    :name(name)
+    {
+        TraceRecord(name, TraceEventType::BEGIN);
+    }
+
+    ~TraceScope()
+    {
+        TraceRecord(name, TraceEventType::END);
+    }
+};
+
+#define PHYSICS_TRACE_CONCAT_INNER(a, b) a##b
+#define PHYSICS_TRACE_CONCAT(a, b) PHYSICS_TRACE_CONCAT_INNER(a, b)
+
+#ifdef PHYSICS_TRACING
+    #define PHYSICS_TRACE_SCOPE(name) TraceScope PHYSICS_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+    #define PHYSICS_TRACE_THREAD_NAME(name) SetTraceThreadName(name)
+#else
+    #define PHYSICS_TRACE_SCOPE(name) ((void)0)
+    #define PHYSICS_TRACE_THREAD_NAME(name) ((void)0)
+#endif
@@ -0,0 +1,429 @@
+#include "trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define TRAJECTORY_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static constexpr uint32_t trajectory_magic = 0x4a415254;  // "TRAJ"
+static constexpr uint32_t frame_magic = 0x4d415246;  // "FRAM"
+static constexpr uint32_t trajectory_version = 1;
+
+enum TrajectoryFlags : uint32_t
+{
+    QUANTISED = 1 << 0
+};
+
+struct TrajectoryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t keyframe_interval;
+    uint32_t body_count;  // Highest body count seen in any frame
+    uint32_t reserved;
+    uint64_t frame_count;  // Only valid once the index is written
+    uint64_t data_end;  // Updated after every frame so a file that was never closed can still be read
+    uint64_t index_offset;  // 0 until the recorder is closed
+};
+
+struct TrajectoryFrameHeader
+{
+    uint32_t magic;
+    uint32_t entry_count;
+    double time;
+};
+
+// Entry: uint32 body id followed by the encoded transform
+// Float: position (3 float) + orientation (x y z w float)
+// Quantised: position (3 int32, 1/4096 m) + smallest three orientation components (3 int16) + index of the dropped component (uint16)
+static constexpr size_t float_transform_size = sizeof(float) * 7;
+static constexpr size_t quantised_transform_size = sizeof(int32_t) * 3 + sizeof(int16_t) * 3 + sizeof(uint16_t);
+static constexpr Real position_scale = 4096.0;
+static constexpr Real orientation_range = 0.70710678118654752440;  // The 3 smallest components of a unit quaternion are within +-1/sqrt(2)
+
+static size_t GetTransformSize(bool quantised)
+{
+    return quantised ? quantised_transform_size : float_transform_size;
+}
+
+static void EncodeTransform(const Transform& transform, bool quantised, uint8_t* out)
+{
+    if (!quantised)
+    {
+        float values[7] = {
+            static_cast<float>(transform.position[0]), static_cast<float>(transform.position[1]), static_cast<float>(transform.position[2]),
+            static_cast<float>(transform.orientation.x()), static_cast<float>(transform.orientation.y()), static_cast<float>(transform.orientation.z()), static_cast<float>(transform.orientation.w())
+        };
+        std::memcpy(out, values, sizeof(values));
+        return;
+    }
+
+    int32_t position[3];
+    for (int i = 0; i < 3; i++)
+    {
+        position[i] = static_cast<int32_t>(std::clamp(std::round(transform.position[i] * position_scale), Real(INT32_MIN), Real(INT32_MAX)));
+    }
+
+    // q and -q are the same rotation, so flip it to make the dropped component positive and rebuild it from the others
+    Eigen::Matrix<Real, 4, 1> q = transform.orientation.coeffs();
+    int largest = 0;
+    q.cwiseAbs().maxCoeff(&largest);
+    if (q[largest] < 0.0) q = -q;
+
+    int16_t components[3];
+    for (int i = 0, j = 0; i < 4; i++)
+    {
+        if (i == largest) continue;
+        components[j++] = static_cast<int16_t>(std::round(std::clamp(q[i] / orientation_range, Real(-1.0), Real(1.0)) * 32767.0));
+    }
+    uint16_t dropped = static_cast<uint16_t>(largest);
+
+    std::memcpy(out, position, sizeof(position));
+    std::memcpy(out + sizeof(position), components, sizeof(components));
+    std::memcpy(out + sizeof(position) + sizeof(components), &dropped, sizeof(dropped));
+}
+
+static Transform DecodeTransform(const uint8_t* in, bool quantised)
+{
+    Transform transform;
+    if (!quantised)
+    {
+        float values[7];
+        std::memcpy(values, in, sizeof(values));
+        transform.position = Vector3(values[0], values[1], values[2]);
+        transform.orientation = Quaternion(values[6], values[3], values[4], values[5]);
+        transform.orientation.normalize();
+        return transform;
+    }
+
+    int32_t position[3];
+    int16_t components[3];
+    uint16_t dropped;
+    std::memcpy(position, in, sizeof(position));
+    std::memcpy(components, in + sizeof(position), sizeof(components));
+    std::memcpy(&dropped, in + sizeof(position) + sizeof(components), sizeof(dropped));
+
+    transform.position = Vector3(position[0], position[1], position[2]) / position_scale;
+
+    Eigen::Matrix<Real, 4, 1> q;
+    Real sum = 0.0;
+    for (int i = 0, j = 0; i < 4; i++)
+    {
+        if (i == dropped) continue;
+        q[i] = components[j++] / 32767.0 * orientation_range;
+        sum += q[i] * q[i];
+    }
+    q[dropped & 3] = std::sqrt(std::max(1.0 - sum, 0.0));
+    transform.orientation.coeffs() = q;
+    transform.orientation.normalize();
+    return transform;
+}
+
+#ifdef TRAJECTORY_MMAP
+
+MappedFile::~MappedFile()
+{
+    close(size);
+}
+
+bool MappedFile::open(const std::string& path, bool writable)
+{
+    this->writable = writable;
+    file = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (file < 0) return false;
+
+    if (writable) return true;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) return false;
+
+    size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    if (mapping == MAP_FAILED) return false;
+
+    data = static_cast<uint8_t*>(mapping);
+    return true;
+}
+
+bool MappedFile::resize(size_t new_size)
+{
+    if (file < 0 || !writable) return false;
+
+    if (data != nullptr) munmap(data, size);
+    data = nullptr;
+
+    if (ftruncate(file, static_cast<off_t>(new_size)) != 0) return false;
+
+    void* mapping = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (mapping == MAP_FAILED) return false;
+
+    data = static_cast<uint8_t*>(mapping);
+    size = new_size;
+    return true;
+}
+
+void MappedFile::close(size_t final_size)
+{
+    if (data != nullptr) munmap(data, size);
+    if (file >= 0)
+    {
+        if (writable && final_size != size) ftruncate(file, static_cast<off_t>(final_size));
+        ::close(file);
+    }
+
+    data = nullptr;
+    file = -1;
+    size = 0;
+}
+
+#else
+
+MappedFile::~MappedFile() {}
+bool MappedFile::open(const std::string& path, bool writable) { return false; }
+bool MappedFile::resize(size_t new_size) { return false; }
+void MappedFile::close(size_t final_size) {}
+
+#endif
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    close();
+}
+
+bool TrajectoryRecorder::open(const std::string& path, const TrajectoryOptions& options)
+{
+    close();
+
+    this->options = options;
+    this->options.keyframe_interval = std::max(options.keyframe_interval, 1u);
+    this->options.chunk_size = std::max(options.chunk_size, static_cast<size_t>(4096));
+
+    index.clear();
+    previous.clear();
+    has_previous.clear();
+
+    if (!file.open(path, true) || !file.resize(this->options.chunk_size)) return false;
+
+    TrajectoryHeader header = {
+        .magic = trajectory_magic,
+        .version = trajectory_version,
+        .flags = options.quantise ? TrajectoryFlags::QUANTISED : 0u,
+        .keyframe_interval = this->options.keyframe_interval,
+        .body_count = 0,
+        .reserved = 0,
+        .frame_count = 0,
+        .data_end = sizeof(TrajectoryHeader),
+        .index_offset = 0
+    };
+    std::memcpy(file.getData(), &header, sizeof(header));
+    used = sizeof(header);
+
+    return true;
+}
+
+bool TrajectoryRecorder::reserve(size_t bytes)
+{
+    if (used + bytes <= file.getSize()) return true;
+
+    size_t chunks = (used + bytes - file.getSize() + options.chunk_size - 1) / options.chunk_size;
+    return file.resize(file.getSize() + chunks * options.chunk_size);
+}
+
+void TrajectoryRecorder::recordFrame(const PhysicsWorld& world, Real time)
+{
+    if (!file.isOpen()) return;
+
+    uint32_t body_count = world.getBodyCount();
+    size_t transform_size = GetTransformSize(options.quantise);
+    size_t entry_size = sizeof(uint32_t) + transform_size;
+    if (!reserve(sizeof(TrajectoryFrameHeader) + body_count * entry_size)) return;
+
+    previous.resize(body_count * transform_size);
+    has_previous.resize(body_count, 0);
+
+    bool keyframe = index.size() % options.keyframe_interval == 0;
+    uint8_t* frame = file.getData() + used;
+    uint8_t* out = frame + sizeof(TrajectoryFrameHeader);
+
+    uint32_t entry_count = 0;
+    uint8_t encoded[quantised_transform_size > float_transform_size ? quantised_transform_size : float_transform_size];
+    for (uint32_t id = 0; id < body_count; id++)
+    {
+        EncodeTransform(world.getTransform(id), options.quantise, encoded);
+
+        uint8_t* last = &previous[id * transform_size];
+        if (!keyframe && has_previous[id] && std::memcmp(encoded, last, transform_size) == 0) continue;
+
+        std::memcpy(last, encoded, transform_size);
+        has_previous[id] = 1;
+
+        std::memcpy(out, &id, sizeof(id));
+        std::memcpy(out + sizeof(id), encoded, transform_size);
+        out += entry_size;
+        entry_count++;
+    }
+
+    TrajectoryFrameHeader frame_header = { .magic = frame_magic, .entry_count = entry_count, .time = time };
+    std::memcpy(frame, &frame_header, sizeof(frame_header));
+
+    index.push_back(used);
+    used = static_cast<size_t>(out - file.getData());
+
+    TrajectoryHeader header;
+    std::memcpy(&header, file.getData(), sizeof(header));
+    header.data_end = used;
+    header.body_count = std::max(header.body_count, body_count);
+    std::memcpy(file.getData(), &header, sizeof(header));
+}
+
+void TrajectoryRecorder::close()
+{
+    if (!file.isOpen()) return;
+
+    if (reserve(index.size() * sizeof(uint64_t)))
+    {
+        std::memcpy(file.getData() + used, index.data(), index.size() * sizeof(uint64_t));
+
+        TrajectoryHeader header;
+        std::memcpy(&header, file.getData(), sizeof(header));
+        header.frame_count = index.size();
+        header.index_offset = used;
+        std::memcpy(file.getData(), &header, sizeof(header));
+
+        used += index.size() * sizeof(uint64_t);
+    }
+
+    file.close(used);
+}
+
+// True when a whole frame (header and every entry) starts at offset and ends before data_end
+static bool ReadFrameHeader(const uint8_t* data, uint64_t offset, uint64_t data_end, size_t entry_size, TrajectoryFrameHeader& frame)
+{
+    if (offset < sizeof(TrajectoryHeader) || offset > data_end || data_end - offset < sizeof(TrajectoryFrameHeader)) return false;
+
+    std::memcpy(&frame, data + offset, sizeof(frame));
+    return frame.magic == frame_magic && frame.entry_count <= (data_end - offset - sizeof(frame)) / entry_size;
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+    file.close(0);
+    index.clear();
+    transforms.clear();
+    current_frame = -1;
+    current_time = 0.0;
+
+    if (!file.open(path, false) || file.getSize() < sizeof(TrajectoryHeader)) return false;
+
+    TrajectoryHeader header;
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (header.magic != trajectory_magic || header.version != trajectory_version || header.data_end > file.getSize()) return false;
+
+    quantised = (header.flags & TrajectoryFlags::QUANTISED) != 0;
+    keyframe_interval = std::max(header.keyframe_interval, 1u);
+
+    // Keyframes hold every body, so a body count that can't fit in the data is a broken file (and would be a huge allocation)
+    size_t entry_size = sizeof(uint32_t) + GetTransformSize(quantised);
+    if (header.body_count > header.data_end / entry_size) return false;
+    transforms.resize(header.body_count);
+
+    if (header.index_offset != 0 && header.index_offset <= file.getSize() && header.frame_count <= (file.getSize() - header.index_offset) / sizeof(uint64_t))
+    {
+        index.resize(header.frame_count);
+        std::memcpy(index.data(), file.getData() + header.index_offset, header.frame_count * sizeof(uint64_t));
+
+        // Frames are only read through the index, so it's cut off at the first entry pointing outside the data
+        for (size_t i = 0; i < index.size(); i++)
+        {
+            TrajectoryFrameHeader frame;
+            if (!ReadFrameHeader(file.getData(), index[i], header.data_end, entry_size, frame))
+            {
+                index.resize(i);
+                break;
+            }
+        }
+        return true;
+    }
+
+    // The recorder never got to write the index, find the frames by walking them
+    uint64_t offset = sizeof(TrajectoryHeader);
+    TrajectoryFrameHeader frame;
+    while (ReadFrameHeader(file.getData(), offset, header.data_end, entry_size, frame))
+    {
+        index.push_back(offset);
+        offset += sizeof(frame) + frame.entry_count * entry_size;
+    }
+    return true;
+}
+
+void TrajectoryReader::applyFrame(uint32_t frame)
+{
+    const uint8_t* in = file.getData() + index[frame];
+
+    TrajectoryFrameHeader header;
+    std::memcpy(&header, in, sizeof(header));
+    in += sizeof(header);
+
+    size_t transform_size = GetTransformSize(quantised);
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        uint32_t id;
+        std::memcpy(&id, in, sizeof(id));
+
+        // The header's body count covers every id the recorder wrote, anything past it is garbage
+        if (id < transforms.size()) transforms[id] = DecodeTransform(in + sizeof(id), quantised);
+        in += sizeof(id) + transform_size;
+    }
+
+    current_frame = frame;
+    current_time = header.time;
+}
+
+bool TrajectoryReader::seek(uint32_t frame)
+{
+    if (frame >= index.size()) return false;
+
+    // Keyframes hold every body, so everything before one can be skipped
+    uint32_t keyframe = frame - frame % keyframe_interval;
+    if (current_frame < keyframe || current_frame > frame)
+    {
+        applyFrame(keyframe);
+    }
+
+    for (uint32_t i = static_cast<uint32_t>(current_frame) + 1; i <= frame; i++)
+    {
+        applyFrame(i);
+    }
+    return true;
+}
+
+bool TrajectoryReader::next()
+{
+    if (current_frame + 1 >= static_cast<int64_t>(index.size())) return false;
+
+    applyFrame(static_cast<uint32_t>(current_frame + 1));
+    return true;
+}
+
+Transform TrajectoryReader::getTransform(BodyID id) const
+{
+    if (id < 0 || id >= static_cast<BodyID>(transforms.size())) return Transform{};
+    return transforms[id];
+}
+
+Matrix4 TrajectoryReader::getWorldMatrix(BodyID id) const
+{
+    if (id < 0 || id >= static_cast<BodyID>(transforms.size())) return Matrix4::Identity();
+
+    Affine3 mat = Affine3::Identity();
+    mat.translate(transforms[id].position);
+    mat.rotate(transforms[id].orientation);
+    return mat.matrix();
+}
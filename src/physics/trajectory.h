@@ -0,0 +1,107 @@
+#pragma once
+#include "physics.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Trajectory recording / replay.
+    Every recorded step appends a frame of body transforms to a memory-mapped file that grows in chunks.
+    Frames only hold the bodies whose (encoded) transform changed, except keyframes (every keyframe_interval frames) which hold every body.
+    An index of frame offsets is written when the recorder is closed, so the reader can jump to any frame and only has to
+    apply at most keyframe_interval frames to rebuild it (without an index, e.g. after a crash, the reader rebuilds it by scanning).
+
+    Mapping is POSIX only for now, open() returns false elsewhere.
+*/
+
+struct TrajectoryOptions
+{
+    // Positions as 32 bit fixed point (1/4096 m) and orientations as smallest-three 16 bit components instead of floats
+    bool quantise = false;
+    uint32_t keyframe_interval = 60;
+    size_t chunk_size = 16 * 1024 * 1024;
+};
+
+class MappedFile
+{
+    private:
+        int file = -1;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        bool writable = false;
+
+    public:
+        MappedFile() {}
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path, bool writable);
+        bool resize(size_t new_size);
+        void close(size_t final_size);
+
+        uint8_t* getData() const { return data; }
+        size_t getSize() const { return size; }
+        bool isOpen() const { return data != nullptr; }
+};
+
+class TrajectoryRecorder
+{
+    private:
+        MappedFile file;
+        TrajectoryOptions options;
+
+        size_t used = 0;
+        std::vector<uint64_t> index;
+
+        // Last written transform of every body in encoded form, used to skip bodies that didn't change
+        std::vector<uint8_t> previous;
+        std::vector<uint8_t> has_previous;
+
+        bool reserve(size_t bytes);
+
+    public:
+        ~TrajectoryRecorder();
+
+        bool open(const std::string& path, const TrajectoryOptions& options = {});
+        void recordFrame(const PhysicsWorld& world, Real time);
+
+        // Writes the index and trims the file, also done by the destructor
+        void close();
+
+        uint32_t getFrameCount() const { return static_cast<uint32_t>(index.size()); }
+};
+
+class TrajectoryReader
+{
+    private:
+        MappedFile file;
+        bool quantised = false;
+        uint32_t keyframe_interval = 1;
+
+        std::vector<uint64_t> index;
+        std::vector<Transform> transforms;
+
+        int64_t current_frame = -1;
+        Real current_time = 0.0;
+
+        void applyFrame(uint32_t frame);
+
+    public:
+        bool open(const std::string& path);
+
+        uint32_t getFrameCount() const { return static_cast<uint32_t>(index.size()); }
+        uint32_t getBodyCount() const { return static_cast<uint32_t>(transforms.size()); }
+
+        // Rebuilds the state at any frame (from the keyframe at or before it)
+        bool seek(uint32_t frame);
+
+        // Moves to the next frame, returns false at the end
+        bool next();
+
+        int64_t getCurrentFrame() const { return current_frame; }
+        Real getTime() const { return current_time; }
+        // Both give the identity for an id outside the recording
+        Transform getTransform(BodyID id) const;
+        Matrix4 getWorldMatrix(BodyID id) const;
+};
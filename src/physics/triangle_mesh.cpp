@@ -0,0 +1,111 @@
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <cmath>
+
+TriangleMesh::TriangleMesh(const std::vector<Vector3>& source_vertices, const std::vector<uint32_t>& indices)
+{
+    uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    if (triangle_count == 0) return;
+
+    // Flatten the indexed mesh so every triangle owns its 3 vertices
+    std::vector<Vector3> source;
+    source.reserve(triangle_count * 3);
+    for (uint32_t i = 0; i < triangle_count * 3; i++)
+    {
+        source.push_back(source_vertices[indices[i]]);
+    }
+
+    std::vector<Vector3> centroids(triangle_count);
+    std::vector<uint32_t> order(triangle_count);
+
+    bounds_min = source[0];
+    bounds_max = source[0];
+    for (uint32_t i = 0; i < triangle_count; i++)
+    {
+        const Vector3* triangle = &source[i * 3];
+        centroids[i] = (triangle[0] + triangle[1] + triangle[2]) / 3.0;
+        order[i] = i;
+
+        for (int j = 0; j < 3; j++)
+        {
+            bounds_min = bounds_min.cwiseMin(triangle[j]);
+            bounds_max = bounds_max.cwiseMax(triangle[j]);
+        }
+    }
+
+    // Flat axes (e.g. a ground plane) get a scale of 0 so everything quantises to 0 on that axis
+    Vector3 extent = bounds_max - bounds_min;
+    for (int i = 0; i < 3; i++)
+    {
+        quantise_scale[i] = (extent[i] > 1e-9) ? 65535.0 / extent[i] : 0.0;
+    }
+
+    // A median split tree has at most 2 * leaves - 1 nodes
+    nodes.reserve(2 * (triangle_count / max_leaf_triangles + 1));
+    vertices.reserve(triangle_count * 3);
+    buildNode(order, centroids, source, 0, triangle_count);
+}
+
+uint32_t TriangleMesh::buildNode(std::vector<uint32_t>& order, const std::vector<Vector3>& centroids, const std::vector<Vector3>& source, uint32_t begin, uint32_t end)
+{
+    Vector3 min = source[order[begin] * 3];
+    Vector3 max = min;
+    Vector3 centroid_min = centroids[order[begin]];
+    Vector3 centroid_max = centroid_min;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const Vector3* triangle = &source[order[i] * 3];
+        for (int j = 0; j < 3; j++)
+        {
+            min = min.cwiseMin(triangle[j]);
+            max = max.cwiseMax(triangle[j]);
+        }
+        centroid_min = centroid_min.cwiseMin(centroids[order[i]]);
+        centroid_max = centroid_max.cwiseMax(centroids[order[i]]);
+    }
+
+    uint32_t node_index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(MeshBVHNode{});
+    quantise(min, max, nodes[node_index].min, nodes[node_index].max);
+
+    uint32_t count = end - begin;
+    if (count <= max_leaf_triangles)
+    {
+        uint32_t first_triangle = static_cast<uint32_t>(vertices.size() / 3);
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const Vector3* triangle = &source[order[i] * 3];
+            vertices.push_back(triangle[0]);
+            vertices.push_back(triangle[1]);
+            vertices.push_back(triangle[2]);
+        }
+        nodes[node_index].data = (first_triangle << 3) | count;
+        return node_index;
+    }
+
+    // Object median split along the widest centroid axis keeps the tree balanced (depth ~ log2(n)) even for degenerate input
+    int axis = 0;
+    (centroid_max - centroid_min).maxCoeff(&axis);
+
+    uint32_t middle = begin + count / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+
+    buildNode(order, centroids, source, begin, middle);
+    uint32_t right_child = buildNode(order, centroids, source, middle, end);
+    nodes[node_index].data = right_child << 3;
+
+    return node_index;
+}
+
+void TriangleMesh::quantise(const Vector3& min, const Vector3& max, uint16_t* qmin, uint16_t* qmax) const
+{
+    for (int i = 0; i < 3; i++)
+    {
+        Real low = std::floor((min[i] - bounds_min[i]) * quantise_scale[i]);
+        Real high = std::ceil((max[i] - bounds_min[i]) * quantise_scale[i]);
+        qmin[i] = static_cast<uint16_t>(std::clamp(low, Real(0.0), Real(65535.0)));
+        qmax[i] = static_cast<uint16_t>(std::clamp(high, Real(0.0), Real(65535.0)));
+    }
+}
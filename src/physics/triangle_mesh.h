@@ -0,0 +1,98 @@
+#pragma once
+#include "physics.h"
+#include <cstdint>
+
+/*
+    Static triangle mesh used for level geometry.
+    The BVH is built once when the mesh is created and is never refit, so meshes should only be put on STATIC bodies.
+    Everything in here is in the mesh's local space (the body transform is applied by the collision functions).
+*/
+
+struct MeshBVHNode
+{
+    // Bounds are quantised to 16 bits relative to the mesh bounds (min rounded down and max rounded up so they stay conservative)
+    uint16_t min[3];
+    uint16_t max[3];
+
+    // Low 3 bits hold the triangle count (0 for interior nodes)
+    // Leaf: the rest is the index of the first triangle. Interior: the rest is the index of the right child (left child is always the next node)
+    uint32_t data;
+};
+static_assert(sizeof(MeshBVHNode) == 16, "BVH nodes should stay 16 bytes so four fit in a cache line");
+
+class TriangleMesh
+{
+    private:
+        // 3 vertices per triangle, stored in BVH leaf order so a leaf reads one contiguous block
+        std::vector<Vector3> vertices;
+        std::vector<MeshBVHNode> nodes;
+
+        Vector3 bounds_min = Vector3::Zero();
+        Vector3 bounds_max = Vector3::Zero();
+        Vector3 quantise_scale = Vector3::Zero();
+
+        static constexpr uint32_t max_leaf_triangles = 4;
+        static constexpr uint32_t max_depth = 64;
+
+        uint32_t buildNode(std::vector<uint32_t>& order, const std::vector<Vector3>& centroids, const std::vector<Vector3>& source, uint32_t begin, uint32_t end);
+        void quantise(const Vector3& min, const Vector3& max, uint16_t* qmin, uint16_t* qmax) const;
+
+    public:
+        TriangleMesh(const std::vector<Vector3>& vertices, const std::vector<uint32_t>& indices);
+
+        uint32_t triangleCount() const { return static_cast<uint32_t>(vertices.size() / 3); }
+        const Vector3* getTriangle(uint32_t index) const { return &vertices[index * 3]; }
+        const std::vector<MeshBVHNode>& getNodes() const { return nodes; }
+
+        Vector3 getBoundsMin() const { return bounds_min; }
+        Vector3 getBoundsMax() const { return bounds_max; }
+
+        // Calls func(const Vector3* triangle) for every triangle whose leaf overlaps the box [min, max]
+        template <typename Func>
+        void queryTriangles(const Vector3& min, const Vector3& max, Func&& func) const;
+};
+
+template <typename Func>
+void TriangleMesh::queryTriangles(const Vector3& min, const Vector3& max, Func&& func) const
+{
+    if (nodes.empty()) return;
+
+    // Reject against the real bounds first so clamping the quantised query can't create false overlaps
+    if ((min.array() > bounds_max.array()).any() || (max.array() < bounds_min.array()).any()) return;
+
+    uint16_t qmin[3], qmax[3];
+    quantise(min, max, qmin, qmax);
+
+    uint32_t stack[max_depth];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        uint32_t node_index = stack[--stack_size];
+        const MeshBVHNode& node = nodes[node_index];
+
+        if (node.min[0] > qmax[0] || node.max[0] < qmin[0] ||
+            node.min[1] > qmax[1] || node.max[1] < qmin[1] ||
+            node.min[2] > qmax[2] || node.max[2] < qmin[2])
+        {
+            continue;
+        }
+
+        uint32_t count = node.data & 0x7;
+        uint32_t offset = node.data >> 3;
+
+        if (count > 0)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                func(getTriangle(offset + i));
+            }
+        }
+        else
+        {
+            stack[stack_size++] = offset;
+            stack[stack_size++] = node_index + 1;
+        }
+    }
+}
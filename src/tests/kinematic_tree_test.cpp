@@ -0,0 +1,107 @@
+#include "test_check.h"
+#include "kinematic_tree.h"
+#include <algorithm>
+#include <random>
+
+/*
+    The articulated-body algorithm and RNEA are inverses of each other: feeding the accelerations forward dynamics gives for some torques
+    back into inverse dynamics has to give the same torques, down to rounding. Checked on a branching tree with every joint type, off
+    centre masses, a moving base pose and gravity, over a spread of random states.
+*/
+
+// std::uniform_real_distribution differs between standard libraries, this doesn't
+static Real RandomRange(std::mt19937& rng, Real min, Real max)
+{
+    return min + (max - min) * (static_cast<Real>(rng()) / static_cast<Real>(std::mt19937::max()));
+}
+
+static Vector3 RandomVector(std::mt19937& rng, Real range)
+{
+    return Vector3(RandomRange(rng, -range, range), RandomRange(rng, -range, range), RandomRange(rng, -range, range));
+}
+
+static Quaternion RandomOrientation(std::mt19937& rng)
+{
+    Quaternion q(RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0), RandomRange(rng, -1.0, 1.0));
+    if (q.squaredNorm() < 1e-6) return Quaternion::Identity();
+    return q.normalized();
+}
+
+static void BuildTree(KinematicTree& tree, std::mt19937& rng)
+{
+    // Root, two arms off it, and a spherical wrist on each arm
+    const TreeJointType types[] = { REVOLUTE, REVOLUTE, PRISMATIC, SPHERICAL, REVOLUTE, SPHERICAL, PRISMATIC, REVOLUTE };
+    const int32_t parents[] = { -1, 0, 0, 1, 2, 3, 4, 5 };
+
+    for (int i = 0; i < 8; i++)
+    {
+        Transform joint_frame{ .position = RandomVector(rng, 0.5), .orientation = RandomOrientation(rng) };
+        Vector3 axis = RandomVector(rng, 1.0).normalized();
+        PhysicsShape shape = (i % 2 == 0) ? PhysicsShape::MakeOBB(Vector3(0.1, 0.3, 0.05) + RandomVector(rng, 0.02)) : PhysicsShape::MakeSphere(0.15);
+
+        tree.addLink(parents[i], types[i], axis, joint_frame, shape, RandomRange(rng, 0.5, 3.0), RandomVector(rng, 0.2));
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(1234);
+
+    KinematicTree tree;
+    BuildTree(tree, rng);
+    tree.setGravity(Vector6(0.0, 0.0, 0.0, 0.0, -9.8, 0.0));
+
+    Eigen::Index position_count = tree.getJointPositions().size();
+    Eigen::Index velocity_count = tree.getJointVelocities().size();
+    CHECK(position_count == 6 + 2 * 4);
+    CHECK(velocity_count == 6 + 2 * 3);
+
+    Real worst = 0.0;
+    for (int sample = 0; sample < 100; sample++)
+    {
+        tree.setBaseTransform(Transform{ .position = RandomVector(rng, 2.0), .orientation = RandomOrientation(rng) });
+
+        VectorX q(position_count);
+        for (int32_t link = 0; link < static_cast<int32_t>(tree.getLinkCount()); link++)
+        {
+            uint32_t offset = tree.getPositionOffset(link);
+            uint32_t next = (link + 1 < static_cast<int32_t>(tree.getLinkCount())) ? tree.getPositionOffset(link + 1) : static_cast<uint32_t>(position_count);
+            if (next - offset == 4)
+            {
+                q.segment<4>(offset) = RandomOrientation(rng).coeffs();
+            }
+            else
+            {
+                q[offset] = RandomRange(rng, -2.0, 2.0);
+            }
+        }
+
+        VectorX qd(velocity_count), tau(velocity_count);
+        for (Eigen::Index i = 0; i < velocity_count; i++)
+        {
+            qd[i] = RandomRange(rng, -3.0, 3.0);
+            tau[i] = RandomRange(rng, -10.0, 10.0);
+        }
+
+        tree.setJointPositions(q);
+        tree.setJointVelocities(qd);
+        tree.setJointTorques(tau);
+        tree.calculateForwardDynamics();
+
+        VectorX qdd = tree.getJointAccelerations();
+        CHECK(qdd.allFinite());
+
+        VectorX result;
+        tree.calculateInverseDynamics(qdd, result);
+        CHECK(result.size() == velocity_count);
+
+        // Relative to the size of the torques and the accelerations that went through the passes
+        Real scale = std::max({ tau.cwiseAbs().maxCoeff(), qdd.cwiseAbs().maxCoeff(), Real(1.0) });
+        worst = std::max(worst, (result - tau).cwiseAbs().maxCoeff() / scale);
+    }
+
+    std::printf("Largest torque error: %g\n", worst);
+    CHECK(worst < 2e-14);
+
+    return TestResult();
+}
@@ -0,0 +1,77 @@
+#include "test_check.h"
+#include "physics.h"
+
+/*
+    Snapshot round trip: restoring a blob has to give back the exact state it was saved from (same state hash), both in the world that
+    saved it and in a fresh one, and stepping on from there has to follow the same path as the original run.
+*/
+
+static const Real STEP = 1.0 / 60.0;
+
+static void BuildScene(PhysicsWorld& world)
+{
+    world.setGravity(Vector6(0.0, 0.0, 0.0, 0.0, -9.8, 0.0));
+    world.createBody(PhysicsShape::MakePlane(Vector2(20.0, 20.0)), Vector3(0.0, 0.0, 0.0), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            Vector3 position(i * 1.5 - 2.25, 1.0 + (i + j) * 0.4, j * 1.5 - 2.25);
+            BodyID id = ((i + j) % 2 == 0)
+                ? world.createBody(PhysicsShape::MakeSphere(0.4), position, 1.0, PhysicsLayer::DYNAMIC)
+                : world.createBody(PhysicsShape::MakeOBB(Vector3(0.3, 0.3, 0.3)), position, Quaternion(Eigen::AngleAxisd(0.3 * i, Vector3(0.0, 1.0, 0.0))), 2.0, PhysicsLayer::DYNAMIC);
+
+            world.setLinearVelocity(id, Vector3(j - 1.5, 0.0, 1.5 - i));
+            world.setAngularVelocity(id, Vector3(0.5 * i, 1.0, -0.5 * j));
+        }
+    }
+}
+
+static void Step(PhysicsWorld& world, int steps)
+{
+    for (int i = 0; i < steps; i++)
+    {
+        world.update(STEP);
+    }
+}
+
+int main()
+{
+    PhysicsWorld world;
+    BuildScene(world);
+
+    // Let things land first so the contact state is saved too
+    Step(world, 60);
+
+    std::vector<uint8_t> blob;
+    CHECK(world.saveSnapshot(blob));
+    uint64_t saved_hash = world.getStateHash();
+
+    Step(world, 60);
+    uint64_t later_hash = world.getStateHash();
+    CHECK(later_hash != saved_hash);
+
+    // Back in the same world
+    CHECK(world.restoreSnapshot(blob));
+    CHECK(world.getStateHash() == saved_hash);
+
+    Step(world, 60);
+    CHECK(world.getStateHash() == later_hash);
+
+    // And in a world that never ran
+    PhysicsWorld fresh;
+    CHECK(fresh.restoreSnapshot(blob));
+    CHECK(fresh.getBodyCount() == world.getBodyCount());
+    CHECK(fresh.getStateHash() == saved_hash);
+
+    Step(fresh, 60);
+    CHECK(fresh.getStateHash() == later_hash);
+
+    // A damaged blob is turned down and leaves the world alone
+    std::vector<uint8_t> truncated(blob.begin(), blob.begin() + blob.size() / 2);
+    CHECK(!fresh.restoreSnapshot(truncated));
+    CHECK(fresh.getStateHash() == later_hash);
+
+    return TestResult();
+}
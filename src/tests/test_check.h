@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+
+/*
+    Bare bones checks for the unit tests, so they don't need a test framework.
+    A failed CHECK prints where it was and counts the failure, the test's main returns TestResult() and CTest picks up the exit code.
+*/
+
+inline int test_failures = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (false)
+
+inline int TestResult()
+{
+    if (test_failures > 0) std::fprintf(stderr, "%d check(s) failed\n", test_failures);
+    return test_failures > 0 ? 1 : 0;
+}
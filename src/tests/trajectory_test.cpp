@@ -0,0 +1,124 @@
+#include "test_check.h"
+#include "physics.h"
+#include "trajectory.h"
+#include <cmath>
+#include <filesystem>
+
+/*
+    Trajectory round trip: records a scene, keeps every body's transform at every step on the side, then seeks the reader around the
+    recording (forwards, backwards, across keyframes) and checks it rebuilds those transforms, for both the float and quantised formats.
+*/
+
+static const Real STEP = 1.0 / 60.0;
+static const uint32_t FRAME_COUNT = 95;
+
+static void BuildScene(PhysicsWorld& world)
+{
+    world.setGravity(Vector6(0.0, 0.0, 0.0, 0.0, -9.8, 0.0));
+    world.createBody(PhysicsShape::MakePlane(Vector2(20.0, 20.0)), Vector3(0.0, 0.0, 0.0), Quaternion::Identity(), 1.0, PhysicsLayer::STATIC);
+
+    for (int i = 0; i < 12; i++)
+    {
+        Vector3 position((i % 4) * 1.5 - 2.25, 1.0 + i * 0.5, (i / 4) * 1.5 - 1.5);
+        BodyID id = (i % 2 == 0)
+            ? world.createBody(PhysicsShape::MakeSphere(0.4), position, 1.0, PhysicsLayer::DYNAMIC)
+            : world.createBody(PhysicsShape::MakeOBB(Vector3(0.3, 0.2, 0.4)), position, Quaternion(Eigen::AngleAxisd(0.4 * i, Vector3(1.0, 0.0, 0.0))), 2.0, PhysicsLayer::DYNAMIC);
+
+        world.setLinearVelocity(id, Vector3(i % 3 - 1.0, 0.0, 1.0 - i % 2));
+        world.setAngularVelocity(id, Vector3(1.0, 0.5 * i, -1.0));
+    }
+}
+
+static bool IsClose(const Transform& read, const Transform& recorded, bool quantised)
+{
+    if (!quantised)
+    {
+        // Positions come back as the floats they were stored as, orientations get renormalised after
+        for (int i = 0; i < 3; i++)
+        {
+            if (read.position[i] != static_cast<float>(recorded.position[i])) return false;
+        }
+        return read.orientation.angularDistance(recorded.orientation) < 1e-6;
+    }
+
+    // 1/4096 m positions and 16 bit orientation components
+    return (read.position - recorded.position).cwiseAbs().maxCoeff() <= 0.5 / 4096.0 + 1e-9 && read.orientation.angularDistance(recorded.orientation) < 1e-3;
+}
+
+static void CheckFrame(const TrajectoryReader& reader, const std::vector<std::vector<Transform>>& recorded, uint32_t frame, bool quantised)
+{
+    CHECK(reader.getCurrentFrame() == frame);
+    CHECK(std::abs(reader.getTime() - (frame + 1) * STEP) < 1e-6);
+
+    for (BodyID id = 0; id < static_cast<BodyID>(recorded[frame].size()); id++)
+    {
+        CHECK(IsClose(reader.getTransform(id), recorded[frame][id], quantised));
+    }
+}
+
+static void TestRoundTrip(bool quantised)
+{
+    std::string path = (std::filesystem::temp_directory_path() / (quantised ? "trajectory_test_quantised.traj" : "trajectory_test.traj")).string();
+    std::vector<std::vector<Transform>> recorded;
+
+    {
+        PhysicsWorld world;
+        BuildScene(world);
+
+        TrajectoryRecorder recorder;
+        CHECK(recorder.open(path, TrajectoryOptions{ .quantise = quantised, .keyframe_interval = 10 }));
+        world.setRecorder(&recorder);
+
+        for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+        {
+            world.update(STEP);
+
+            recorded.emplace_back();
+            for (BodyID id = 0; id < static_cast<BodyID>(world.getBodyCount()); id++)
+            {
+                recorded.back().push_back(world.getTransform(id));
+            }
+        }
+
+        world.setRecorder(nullptr);
+        recorder.close();
+    }
+
+    TrajectoryReader reader;
+    CHECK(reader.open(path));
+    CHECK(reader.getFrameCount() == FRAME_COUNT);
+    CHECK(reader.getBodyCount() == recorded[0].size());
+
+    // Within a keyframe's run, back to an earlier one, onto a keyframe, the last frame and back to the start
+    for (uint32_t frame : { 0u, 37u, 38u, 12u, 94u, 50u, 9u, 10u, 0u })
+    {
+        CHECK(reader.seek(frame));
+        CheckFrame(reader, recorded, frame, quantised);
+    }
+
+    CHECK(!reader.seek(FRAME_COUNT));
+
+    // Playing on from a seek
+    CHECK(reader.seek(50));
+    for (uint32_t frame = 51; frame < FRAME_COUNT; frame++)
+    {
+        CHECK(reader.next());
+        CheckFrame(reader, recorded, frame, quantised);
+    }
+    CHECK(!reader.next());
+
+    // Ids outside the recording give the identity
+    Transform outside = reader.getTransform(static_cast<BodyID>(recorded[0].size()));
+    CHECK(outside.position == Vector3::Zero() && outside.orientation.coeffs() == Quaternion::Identity().coeffs());
+    CHECK(reader.getTransform(-1).position == Vector3::Zero());
+
+    std::filesystem::remove(path);
+}
+
+int main()
+{
+    TestRoundTrip(false);
+    TestRoundTrip(true);
+
+    return TestResult();
+}